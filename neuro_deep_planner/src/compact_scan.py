@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+
+import numpy as np
+from sensor_msgs.msg import LaserScan
+
+# Millimetres per meter of the ranges of neuro_stage_ros/CompactScan and the value of a missing return, as in
+# neuro_stage_ros/compact_scan.h
+COMPACT_SCAN_SCALE = 1000.0
+COMPACT_SCAN_NO_RETURN = 65535
+
+
+def decode_ranges(compact_msg):
+
+    # The uint16 ranges arrive as a list or, if the message was deserialized with numpy, as an array, missing returns
+    # become +inf as in the laser scan
+    compact_ranges = np.asarray(compact_msg.ranges, dtype='uint16')
+    ranges = compact_ranges.astype('float32') / COMPACT_SCAN_SCALE
+    ranges[compact_ranges == COMPACT_SCAN_NO_RETURN] = np.inf
+    return ranges
+
+
+def decode_compact_scan(compact_msg):
+
+    # Restore a laser scan without intensities
+    scan = LaserScan()
+    scan.header = compact_msg.header
+    scan.angle_min = compact_msg.angle_min
+    scan.angle_max = compact_msg.angle_max
+    scan.angle_increment = compact_msg.angle_increment
+    scan.range_min = compact_msg.range_min
+    scan.range_max = compact_msg.range_max
+    scan.ranges = decode_ranges(compact_msg).tolist()
+
+    return scan
@@ -228,12 +228,17 @@ class DDPG:
 
         return self.action
 
-    def set_experience(self, state, reward, is_episode_finished):
+    def set_experience(self, state, reward, is_episode_finished, executed_action=None, action_deadline_missed=False):
 
-        # Make sure we're saving a new old_state for the first experience of every episode
+        # If the wrapper adds the exploration noise the action it executed is the one we learn from
+        if executed_action is not None:
+            self.old_action = executed_action
+
+        # Make sure we're saving a new old_state for the first experience of every episode, and don't learn from
+        # actions the wrapper held or replaced because ours came too late
         if self.first_experience:
             self.first_experience = False
-        else:
+        elif not action_deadline_missed:
             self.data_manager.store_experience_to_file(self.old_state, self.old_action, reward, state,
                                                        is_episode_finished)
 
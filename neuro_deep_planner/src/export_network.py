@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+
+import sys
+import struct
+import numpy as np
+import tensorflow as tf
+
+# Layer types and activations as in neuro_local_planner_wrapper/network_layers.h
+CONVOLUTION = 0
+FULLY_CONNECTED = 1
+LINEAR = 0
+RELU = 1
+
+# Params of the conv layers of the auto encoder and the actor
+STRIDE1 = 2
+STRIDE2 = 2
+STRIDE3 = 2
+
+# Number of fully connected layers of the actor
+FULLY_LAYERS = 3
+
+
+def write_network(file_name, layers):
+
+    # Layers are tuples (type, activation, stride, weights, biases) with the weights in TensorFlow layout
+    with open(file_name, 'wb') as f:
+        f.write(b'NEURONET')
+        f.write(struct.pack('<II', 1, len(layers)))
+
+        for layer_type, activation, stride, weights, biases in layers:
+            weights = np.asarray(weights, dtype='<f4')
+            biases = np.asarray(biases, dtype='<f4')
+
+            if layer_type == CONVOLUTION:
+                kernel_size, _, input_size, output_size = weights.shape
+            else:
+                kernel_size = 0
+                input_size, output_size = weights.shape
+
+            f.write(struct.pack('<IIIIII', layer_type, activation, kernel_size, stride, input_size, output_size))
+            f.write(weights.tobytes())
+            f.write(biases.tobytes())
+
+
+def export_encoder(checkpoint_path, file_name):
+
+    # The auto encoder saves its encoder half under these names
+    reader = tf.train.NewCheckpointReader(checkpoint_path)
+
+    layers = []
+    for i, stride in enumerate([STRIDE1, STRIDE2, STRIDE3]):
+        layers.append((CONVOLUTION, RELU, stride, reader.get_tensor('weights_conv' + str(i + 1)),
+                       reader.get_tensor('biases_conv' + str(i + 1))))
+
+    write_network(file_name, layers)
+
+
+def export_actor(checkpoint_path, file_name):
+
+    # The actor names its conv variables, the fully connected ones get the default names Variable, Variable_1, ...
+    # in the order they are created in actor.py
+    reader = tf.train.NewCheckpointReader(checkpoint_path)
+
+    layers = []
+    for i, stride in enumerate([STRIDE1, STRIDE2, STRIDE3]):
+        layers.append((CONVOLUTION, RELU, stride, reader.get_tensor('actor/weights_conv' + str(i + 1)),
+                       reader.get_tensor('actor/biases_conv' + str(i + 1))))
+
+    for i in range(FULLY_LAYERS):
+        weights_name = 'actor/Variable' + ('_' + str(2*i) if i > 0 else '')
+        biases_name = 'actor/Variable_' + str(2*i + 1)
+        activation = RELU if i < FULLY_LAYERS - 1 else LINEAR
+        layers.append((FULLY_CONNECTED, activation, 1, reader.get_tensor(weights_name),
+                       reader.get_tensor(biases_name)))
+
+    write_network(file_name, layers)
+
+
+def main():
+
+    if len(sys.argv) != 4 or sys.argv[1] not in ['encoder', 'actor']:
+        sys.exit('usage: export_network.py encoder|actor <checkpoint> <output file>')
+
+    if sys.argv[1] == 'encoder':
+        export_encoder(sys.argv[2], sys.argv[3])
+    else:
+        export_actor(sys.argv[2], sys.argv[3])
+
+
+if __name__ == '__main__':
+    main()
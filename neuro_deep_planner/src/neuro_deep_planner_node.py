@@ -80,8 +80,11 @@ def main():
                     # Send back the action to execute
                     ros_handler.publish_action(agent.get_action(ros_handler.state))
 
-                # Safe the past state and action + the reward and new state into the replay buffer
-                agent.set_experience(ros_handler.state, ros_handler.reward, ros_handler.is_episode_finished)
+                # Safe the past state and action + the reward and new state into the replay buffer, with the noisy
+                # action if the wrapper explores
+                executed_action = ros_handler.executed_action if len(ros_handler.exploration_noise) > 0 else None
+                agent.set_experience(ros_handler.state, ros_handler.reward, ros_handler.is_episode_finished,
+                                     executed_action, ros_handler.action_deadline_missed)
 
             elif ros_handler.new_setting():
 
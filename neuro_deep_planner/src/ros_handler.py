@@ -20,6 +20,22 @@ class ROSHandler:
 
         self.state = np.zeros((self.width, self.height, self.depth), dtype='int8')
 
+        # Scalar features of the latest frame (velocity, goal, previous command, time remaining)
+        self.features = np.zeros(9, dtype='float32')
+
+        # Latent code of the state if the wrapper runs the encoder
+        self.latent = np.zeros(0, dtype='float32')
+
+        # Action the robot executed since the previous transition and when it was applied
+        self.executed_action = np.zeros(2, dtype='float32')
+        self.action_stamp = rospy.Time(0)
+
+        # Did we miss the deadline of the wrapper, i.e. did the robot execute a held or replaced action?
+        self.action_deadline_missed = False
+
+        # Exploration noise the wrapper added to the executed action, empty if it adds none
+        self.exploration_noise = np.zeros(0, dtype='float32')
+
         self.reward = 0.0
         self.is_episode_finished = False
 
@@ -28,9 +44,14 @@ class ROSHandler:
         self.__sub_setting = rospy.Subscriber("/noise_flag", Bool, self.setting_callback)
         self.__pub = rospy.Publisher("neuro_deep_planner/action", Twist, queue_size=10)
 
+        # The wrapper can skip building states until we signal that we are ready
+        self.__pub_ready = rospy.Publisher("neuro_deep_planner/agent_ready", Bool, queue_size=1, latch=True)
+        self.publish_ready(True)
+
         self.__new_msg_flag = False
         self.__new_setting_flag = False
         self.noise_flag = True
+        self.__warned_missing_state = False
 
     def input_callback(self, transition_msg):
 
@@ -43,17 +64,34 @@ class ROSHandler:
             self.state = np.zeros((self.depth, self.width, self.height), dtype='int8')
             self.__init = True
 
+        # The agent acts on the full state, a transition which only carries the latent code (wrapper parameter
+        # latent_only) would leave it with an old state
+        if not transition_msg.is_episode_finished and len(transition_msg.state_representation) == 0:
+            if not self.__warned_missing_state:
+                rospy.logwarn("Got a transition without state, don't set latent_only in the wrapper for this agent")
+                self.__warned_missing_state = True
+            return
+
         # Lets update the new reward
         self.reward = transition_msg.reward
 
         # Check if episode is done or not
         self.is_episode_finished = transition_msg.is_episode_finished
 
+        # The action that led to this transition as executed by the wrapper
+        self.executed_action = np.array([transition_msg.executed_action.linear.x,
+                                         transition_msg.executed_action.linear.y], dtype='float32')
+        self.action_stamp = transition_msg.action_stamp
+        self.action_deadline_missed = bool(transition_msg.action_deadline_missed)
+        self.exploration_noise = np.asarray(transition_msg.exploration_noise, dtype='float32')
+
         # Lets update the new costmap its possible that we need to switch some axes here...
         if not self.is_episode_finished:
-            temp_state = np.asarray(transition_msg.state_representation, dtype='int8').reshape(self.depth, self.height,
-                                                                                               self.width).swapaxes(1, 2)
+            temp_state = np.asarray(transition_msg.state_representation,
+                                    dtype='int8').reshape(self.depth, self.height, self.width).swapaxes(1, 2)
             self.state = np.rollaxis(temp_state, 0, 3)
+            self.features = np.asarray(transition_msg.features, dtype='float32')
+            self.latent = np.asarray(transition_msg.latent, dtype='float32')
 
         # We have received a new msg
         self.__new_msg_flag = True
@@ -75,6 +113,11 @@ class ROSHandler:
         # Send the action back
         self.__pub.publish(vel_cmd)
 
+    def publish_ready(self, ready):
+
+        # Tell the wrapper if we consume transitions, e.g. set to False while training is paused
+        self.__pub_ready.publish(Bool(ready))
+
     def new_msg(self):
 
         # Return true if new msg arrived only once for every new msg
@@ -0,0 +1,71 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_EXPLORATION_NOISE_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_EXPLORATION_NOISE_H_
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+
+#include <string>
+#include <vector>
+
+namespace neuro_local_planner_wrapper
+{
+    // Noise added to the actions for exploration, either an Ornstein-Uhlenbeck process as OUNoise in
+    // neuro_deep_planner/src/ou_noise.py or independent Gaussian samples. Every wrapper has its own process and random
+    // numbers, so one deterministic policy can serve many exploring robots.
+    class ExplorationNoise
+    {
+        public:
+
+            enum Type
+            {
+                NONE,
+                ORNSTEIN_UHLENBECK,
+                GAUSSIAN
+            };
+
+            // Constructor
+            ExplorationNoise();
+
+            // Sets the type ("none", "ou" or "gaussian") and the params of the noise, returns false for an unknown type
+            bool configure(const std::string& type, unsigned int dimension, double mu, double theta, double sigma,
+                           unsigned int seed);
+
+            // Fades the noise out linearly over decay_steps samples as in ddpg.py (0 keeps it constant)
+            void setDecaySteps(unsigned int decay_steps);
+
+            // Switches the noise on or off, it is on after configure
+            void setEnabled(bool enabled);
+
+            void setSigma(double sigma);
+
+            double getSigma() const;
+
+            Type getType() const;
+
+            // Tell if noise is added to the actions
+            bool isActive() const;
+
+            // Pulls the Ornstein-Uhlenbeck process back to mu, e.g. at the end of an episode
+            void reset();
+
+            // Draws the noise for the next action
+            const std::vector<double>& sample();
+
+        private:
+
+            Type type_;
+            bool enabled_;
+            double mu_, theta_, sigma_;
+
+            unsigned int decay_steps_;
+            unsigned int sample_count_;
+
+            // State of the Ornstein-Uhlenbeck process and the last sample
+            std::vector<double> state_;
+            std::vector<double> noise_;
+
+            boost::mt19937 rng_;
+            boost::normal_distribution<double> normal_;
+    };
+};
+#endif
@@ -0,0 +1,28 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_INT8_KERNELS_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_INT8_KERNELS_H_
+
+#include <stdint.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Rows of int8 weight matrices and the input vectors are padded with zeros to a multiple of this length
+    const unsigned int INT8_BLOCK_SIZE = 16;
+
+    // Multiplies a matrix of rows x size int8 values with count vectors of size int8 values (one after another) into
+    // count x rows int32 sums, size has to be a multiple of INT8_BLOCK_SIZE
+    typedef void (*MultiplyInt8)(const int8_t* matrix, const int8_t* vectors, unsigned int rows, unsigned int size,
+                                 unsigned int count, int32_t* sums);
+
+    void multiplyInt8Scalar(const int8_t* matrix, const int8_t* vectors, unsigned int rows, unsigned int size,
+                            unsigned int count, int32_t* sums);
+
+#ifdef NEURO_LOCAL_PLANNER_WRAPPER_AVX2
+    // Built in its own translation unit with AVX2 enabled, only call it if the CPU supports AVX2
+    void multiplyInt8Avx2(const int8_t* matrix, const int8_t* vectors, unsigned int rows, unsigned int size,
+                          unsigned int count, int32_t* sums);
+#endif
+
+    // Returns the fastest kernel the CPU we are running on supports
+    MultiplyInt8 selectMultiplyInt8();
+};
+#endif
@@ -0,0 +1,55 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_MESSAGE_POOL_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_MESSAGE_POOL_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+#include <vector>
+
+namespace neuro_local_planner_wrapper
+{
+    // Preallocated messages which are published as shared pointers. A message is handed out again as soon as roscpp
+    // and all intra-process subscribers released it, so its vectors keep their capacity and publishing does not
+    // allocate in the steady state. Only the publishing thread acquires messages, the subscribers only release them
+    // through the atomic reference count, so no lock is needed.
+    template <class T>
+    class MessagePool
+    {
+        public:
+
+            // Constructor
+            explicit MessagePool(unsigned int size = 4) : next_(0)
+            {
+                for (unsigned int i = 0; i < size; i++)
+                {
+                    messages_.push_back(boost::make_shared<T>());
+                }
+            }
+
+            // Returns a message nobody else holds any more, the pool only grows if all messages are still in use
+            boost::shared_ptr<T> acquire()
+            {
+                for (unsigned int i = 0; i < messages_.size(); i++)
+                {
+                    // start after the last message to give the subscribers as much time as possible
+                    unsigned int index = (next_ + i) % messages_.size();
+                    if (messages_[index].unique())
+                    {
+                        next_ = (index + 1) % messages_.size();
+                        return messages_[index];
+                    }
+                }
+
+                messages_.push_back(boost::make_shared<T>());
+                next_ = 0;
+                return messages_.back();
+            }
+
+        private:
+
+            std::vector<boost::shared_ptr<T> > messages_;
+
+            unsigned int next_;
+    };
+};
+#endif
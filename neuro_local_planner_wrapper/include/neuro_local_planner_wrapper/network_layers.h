@@ -0,0 +1,45 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_NETWORK_LAYERS_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_NETWORK_LAYERS_H_
+
+#include <string>
+#include <vector>
+
+namespace neuro_local_planner_wrapper
+{
+    // One layer of a network exported with neuro_deep_planner/src/export_network.py
+    struct NetworkLayer
+    {
+        enum Type
+        {
+            CONVOLUTION = 0,
+            FULLY_CONNECTED = 1
+        };
+
+        enum Activation
+        {
+            LINEAR = 0,
+            RELU = 1
+        };
+
+        Type type;
+        Activation activation;
+
+        // Only used by convolutions, which are always square and use 'VALID' padding
+        unsigned int kernel_size;
+        unsigned int stride;
+
+        // Input and output channels of a convolution or inputs and outputs of a fully connected layer
+        unsigned int input_size;
+        unsigned int output_size;
+
+        // Weights in TensorFlow layout, i.e. [kernel_size][kernel_size][input_size][output_size] for convolutions and
+        // [input_size][output_size] for fully connected layers
+        std::vector<float> weights;
+        std::vector<float> biases;
+    };
+
+    // Reads all layers of a network file, returns false if the file is missing or broken, i.e. it has unknown layer
+    // types, empty layers or layers whose sizes don't chain
+    bool loadNetworkLayers(const std::string& file_name, std::vector<NetworkLayer>& layers);
+};
+#endif
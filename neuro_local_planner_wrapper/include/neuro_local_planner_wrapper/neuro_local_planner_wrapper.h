@@ -2,6 +2,8 @@
 #define NEURO_LOCAL_PLANNER_WRAPPER_NEURO_LOCAL_PLANNER_WRAPPER_H_
 
 #include <tf/transform_listener.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
 #include <angles/angles.h>
 #include <nav_msgs/Odometry.h>
 #include <costmap_2d/costmap_2d_ros.h>
@@ -12,8 +14,16 @@
 #include <nav_msgs/Path.h>
 #include <std_msgs/Bool.h>
 #include <pluginlib/class_loader.h>
+#include <base_local_planner/odometry_helper_ros.h>
 
 #include <neuro_local_planner_wrapper/Transition.h>
+#include <neuro_msgs/Contact.h>
+#include <neuro_local_planner_wrapper/SetExplorationNoise.h>
+#include <neuro_local_planner_wrapper/exploration_noise.h>
+#include <neuro_local_planner_wrapper/state_encoder.h>
+#include <neuro_local_planner_wrapper/quantized_policy.h>
+#include <neuro_local_planner_wrapper/state_rasterizer.h>
+#include <neuro_local_planner_wrapper/message_pool.h>
 
 #include <nav_msgs/OccupancyGrid.h>
 #include <map_msgs/OccupancyGridUpdate.h>
@@ -23,7 +33,14 @@
 
 #include <tf/tf.h>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 #include <fstream>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
 
 // We use namespaces to keep things seperate under all the planners
 namespace neuro_local_planner_wrapper
@@ -53,31 +70,86 @@ namespace neuro_local_planner_wrapper
         private:
 
             // Callback function for the subscriber to laser scan
-            void buildStateRepresentation(sensor_msgs::LaserScan laser_scan);
+            void callbackLaserScan(const sensor_msgs::LaserScan::ConstPtr& laser_scan);
+
+            // Checks the laser scan for the end of the episode and pools its points for the next frame, which is
+            // only built if is_frame_wanted is set
+            void buildStateRepresentation(const sensor_msgs::LaserScan& laser_scan, bool is_frame_wanted);
 
-            bool isCrashed(double& reward);
+            bool isCrashed(const sensor_msgs::LaserScan& laser_scan, double& reward);
 
             bool isAtGoal(double& reward);
 
-            void initializeCustomizedCostmap();
+            void initializeCustomizedCostmap(ros::NodeHandle& private_nh);
 
             void initializeTransitionMsg();
 
             void setZeroAction();
 
+            void publishAction();
+
             void addMarkerToArray(double x, double y, std::string frame, ros::Time stamp); // to_delete
 
             void callbackAction(geometry_msgs::Twist action);
 
-            void addLaserScanPoints(const sensor_msgs::LaserScan& laser_scan);
+            void callbackAgentReady(std_msgs::Bool agent_ready);
+
+            void callbackContact(const neuro_msgs::Contact::ConstPtr& contact);
+
+            void resetContact();
+
+            bool callbackSetExplorationNoise(neuro_local_planner_wrapper::SetExplorationNoise::Request& request,
+                                             neuro_local_planner_wrapper::SetExplorationNoise::Response& response);
+
+            void addExplorationNoise(geometry_msgs::Twist& action);
+
+            void callbackActionWatchdog(const ros::TimerEvent& event);
+
+            bool isTransitionNeeded();
+
+            void accumulateLaserScanPoints(const sensor_msgs::LaserScan& laser_scan);
+
+            bool isFrameDue(const ros::Time& stamp);
+
+            void addLaserScanPoints();
 
             void addGlobalPlan();
 
+            void updateGoalStencil();
+
+            void addGoal(int goal_x, int goal_y);
+
+            void computeFeatures(std::vector<float>& features);
+
+            void initializeCostTranslationTable();
+
+            void addCostmap();
+
+            void publishCustomizedCostmap();
+
+            void publishTransition(const ros::Time& stamp, bool is_episode_finished, double reward);
+
+            bool lookupTransform(const std::string& target_frame, const std::string& source_frame,
+                                 tf::Transform& transform);
+
+            bool lookupLaserScanTransform(const std::string& laser_scan_frame, tf::Transform& transform);
+
+            void initializeFootprintMask(double padding);
+
+            bool isFootprintHit(const sensor_msgs::LaserScan& laser_scan);
+
             void storeResult(const neuro_local_planner_wrapper::Transition& transition);
 
-            // Listener to get our pose on the map
+            // Listener of move_base, only passed on to the wrapped planner
             tf::TransformListener* tf_;
 
+            // tf2 buffer for our own lookups
+            tf2_ros::Buffer tf_buffer_;
+            boost::shared_ptr<tf2_ros::TransformListener> tf_listener_;
+
+            // Static transformations from the laser scan frames to the robot base frame
+            std::map<std::string, tf::Transform> laser_scan_transforms_;
+
             // --- Publisher & Subscriber ---
 
             // For visualisation, publishers of global and local plan
@@ -94,6 +166,11 @@ namespace neuro_local_planner_wrapper
             // Subscribe to laser scan topic
             ros::Subscriber laser_scan_sub_;
 
+            // Ready signal of the planning node, states are only built while it is ready if we wait for it
+            ros::Subscriber agent_ready_sub_;
+            bool wait_for_agent_ready_;
+            bool agent_ready_;
+
             // For visualisation, publisher for customized costmap
             ros::Publisher customized_costmap_pub_;
 
@@ -103,6 +180,9 @@ namespace neuro_local_planner_wrapper
             // Publisher for toggling noise for exploration
             ros::Publisher noise_flag_pub_;
 
+            // Service to switch our own exploration noise on or off
+            ros::ServiceServer exploration_noise_srv_;
+
             // TODO: remove
             // ros::Publisher debug_marker_pub_;
 
@@ -115,24 +195,146 @@ namespace neuro_local_planner_wrapper
             // Customized costmap as state representation of the robot base
             nav_msgs::OccupancyGrid customized_costmap_;
 
+            // Geometry of the state representation and the rasterizer specialized for it
+            RasterGeometry raster_geometry_;
+            RasterizerFunctions rasterizer_;
+
+            // Should we copy the local costmap into the state representation instead of drawing the laser scans?
+            bool costmap_state_;
+
+            // Gray value for each cost of the local costmap
+            int8_t cost_translation_table_[256];
+
+            // Should we detect collisions with the laser scans instead of the local costmap? Then the local costmap is
+            // not needed for the state and can be turned off or slowed down.
+            bool scan_collision_;
+
+            // Should we take the collisions from the stall and the clearance the simulator reports instead? A robot
+            // closer than crash_clearance_ to an obstacle counts as crashed as well.
+            bool simulator_collision_;
+            ros::Subscriber contact_sub_;
+            bool is_stalled_;
+            double min_clearance_;
+            ros::Time contact_stamp_;
+            double crash_clearance_;
+
+            // Robot centered grid with the cells covered by the padded footprint
+            std::vector<bool> footprint_mask_;
+            int footprint_mask_radius_;
+            int footprint_mask_size_;
+
+            // Laser scan points of all scans since the last frame, given in the global frame of the local costmap so
+            // that the robot motion between scans is compensated when they are drawn into the next frame
+            std::vector<tf::Point> accumulated_scan_points_;
+
+            // Rate at which frames are built, independent of the laser rate (0 builds one frame per laser scan)
+            double state_rate_;
+            ros::Time last_frame_stamp_;
+
             // Indicates whether episode is running or not e.g. reached the goal or crashed
             bool is_running_;
 
-            // Transition message with actual state representation which is four consecutive costmaps stacked together
-            // in one vector and actual reward
+            // Transition message with the header and size of the state representation, the published transitions
+            // are taken from the pool
             neuro_local_planner_wrapper::Transition transition_msg_;
 
+            // Four consecutive costmaps stacked together in one vector as state representation of the next transition
+            std::vector<int8_t> frame_stack_;
+
+            // Published messages, recycled once the subscribers released them
+            MessagePool<neuro_local_planner_wrapper::Transition> transition_pool_;
+            MessagePool<nav_msgs::OccupancyGrid> costmap_pool_;
+
             visualization_msgs::MarkerArray marker_array_; // to_delete
 
-            // last action received from network
+            // Optional int8 version of the actor to drive without the planning node
+            QuantizedPolicy policy_;
+            std::vector<float> policy_action_;
+
+            // Action repeat, number of states per decision of the planning node, frames since the last decision and
+            // the sum of their rewards
+            int action_repeat_;
+            int frames_since_decision_;
+            double accumulated_reward_;
+
+            // Optional encoder to send latent codes along with the full state representation or, if latent_only_ is
+            // set, instead of it. Then every raw_frame_interval_-th transition still carries the state for debugging.
+            StateEncoder state_encoder_;
+            bool latent_only_;
+            int raw_frame_interval_;
+            int transitions_since_raw_frame_;
+
+            // last action received from network and when it was applied
             geometry_msgs::Twist action_;
+            ros::Time action_applied_stamp_;
+
+            // Exploration noise added to the actions of the network, the noise of the last action and the bound the
+            // noisy action is scaled back into
+            ExplorationNoise exploration_noise_;
+            std::vector<float> action_noise_;
+            double noise_action_bound_;
+
+            // Watchdog for the actions of the planning node, if the reply to the last published transition is
+            // overdue by action_deadline_ the last action is held, decayed by action_decay_ per check or replaced by
+            // the plugin
+            enum ActionFallback
+            {
+                HOLD,
+                DECAY,
+                PLUGIN
+            };
+            ros::Timer action_watchdog_timer_;
+            ros::Time transition_stamp_;
+            bool is_action_pending_;
+            double action_deadline_;
+            ActionFallback action_fallback_;
+            double action_decay_;
+            bool is_deadline_missed_;
+            int deadline_miss_count_;
+
+            // Set by every deadline miss until the next transition reports it, is_deadline_missed_ is already cleared
+            // when the late action comes
+            bool is_deadline_missed_since_transition_;
+
+            // In sync mode the frame is built from the latest laser scan in computeVelocityCommands, which waits up to
+            // action_timeout_ for the next action (counted by action_count_). The scans received since the previous
+            // control cycle are kept in pending_scans_, they are still checked for collisions and drawn into the frame.
+            bool sync_to_control_;
+            double action_timeout_;
+            unsigned int action_count_;
+            std::deque<sensor_msgs::LaserScan::ConstPtr> pending_scans_;
+
+            // The laser scan callback and the control cycle of move_base run in different threads
+            boost::mutex state_mutex_;
+            boost::mutex scan_mutex_;
+            boost::mutex action_mutex_;
+            boost::condition_variable action_condition_;
 
             // Our current pose
             tf::Stamped<tf::Pose> current_pose_;
 
+            // Gives us the velocity of the robot for the features of the transition message
+            base_local_planner::OdometryHelperRos odom_helper_;
+
+            // Goal of the global plan in the robot base frame, updated with every frame, and whether it could be
+            // transformed for the latest frame
+            tf::Point goal_robot_base_frame_;
+            bool is_goal_known_;
+
             // The current global plan in normal and costmap coordinates
             std::vector<geometry_msgs::PoseStamped> global_plan_;
 
+            // Distance to the goal at which an episode is finished
+            double goal_tolerance_;
+
+            // Cell offsets of the goal blob and the resolution and goal tolerance they were computed for
+            std::vector<std::pair<int, int> > goal_stencil_;
+            double goal_stencil_resolution_;
+            double goal_stencil_tolerance_;
+
+            // Path length in meters over which the plan fades from white at the goal to PLAN_MAX_LEVEL
+            double plan_gradient_length_;
+
             // Should we use an existing planner plugin to gather samples?
             // Then we need all of these variables...
             bool existing_plugin_;
@@ -0,0 +1,85 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_QUANTIZED_POLICY_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_QUANTIZED_POLICY_H_
+
+#include <neuro_local_planner_wrapper/network_layers.h>
+#include <neuro_local_planner_wrapper/int8_kernels.h>
+
+#include <stdint.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Runs the actor of neuro_deep_planner/src/actor.py with int8 weights and activations, so the robot can drive
+    // without TensorFlow. The weights are quantized symmetrically per output channel when loading, the activations
+    // of every layer get their own scale per state. The state is used as int8 input as it is.
+    class QuantizedPolicy
+    {
+        public:
+
+            // Constructor
+            QuantizedPolicy();
+
+            // Loads and quantizes the actor layers from a file written by export_network.py
+            bool load(const std::string& file_name);
+
+            // Tell if a policy was loaded
+            bool isLoaded() const;
+
+            // Computes the action for a state of depth stacked frames with width x height cells (as in the
+            // transition message)
+            bool act(const std::vector<int8_t>& state, unsigned int width, unsigned int height, unsigned int depth,
+                     std::vector<float>& action);
+
+            // Computes the actions for a batch of states of the same size. The convolutions run state by state, the
+            // fully connected layers multiply each weight row with all states of the batch at once.
+            bool actBatch(const std::vector<const std::vector<int8_t>*>& states, unsigned int width,
+                          unsigned int height, unsigned int depth, std::vector<std::vector<float> >& actions);
+
+        private:
+
+            struct QuantizedLayer
+            {
+                NetworkLayer::Type type;
+                NetworkLayer::Activation activation;
+                unsigned int kernel_size;
+                unsigned int stride;
+                unsigned int input_size;
+                unsigned int output_size;
+
+                // Weights of each output as one row of row_size values, padded with zeros to the block size of the
+                // kernels, and the scale of each row
+                unsigned int row_size;
+                std::vector<int8_t> weights;
+                std::vector<float> weight_scales;
+                std::vector<float> biases;
+            };
+
+            void quantize(const NetworkLayer& layer, QuantizedLayer& quantized);
+
+            // Applies a 'VALID' convolution and its activation on the int8 input of rows x cols x input_size values
+            void convolve(const QuantizedLayer& layer, float input_scale, unsigned int rows, unsigned int cols,
+                          std::vector<float>& output);
+
+            // Applies a fully connected layer and its activation on the int8 inputs of count states in
+            // batch_input_, each with its scale in batch_scales_
+            void multiply(const QuantizedLayer& layer, unsigned int count, std::vector<float>& output);
+
+            // Quantizes size outputs of a layer as input of the next one, padded with zeros to padded_size values,
+            // and returns their scale
+            float quantizeActivations(const float* values, unsigned int size, unsigned int padded_size,
+                                      int8_t* quantized);
+
+            std::vector<QuantizedLayer> layers_;
+
+            MultiplyInt8 multiply_int8_;
+
+            // Buffers for the layer in- and outputs, reused for every state
+            std::vector<int8_t> input_, patch_;
+            std::vector<int32_t> sums_;
+            std::vector<float> output_;
+
+            // Inputs and their scales of the fully connected layers for all states of a batch
+            std::vector<int8_t> batch_input_;
+            std::vector<float> batch_scales_;
+    };
+};
+#endif
@@ -0,0 +1,42 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_STATE_ENCODER_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_STATE_ENCODER_H_
+
+#include <neuro_local_planner_wrapper/network_layers.h>
+
+#include <stdint.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Runs the convolutional encoder half of the auto encoder in neuro_deep_planner/src/autoencoder.py on the state
+    // representation so that only the latent code has to be sent to the planning node
+    class StateEncoder
+    {
+        public:
+
+            // Constructor
+            StateEncoder();
+
+            // Loads the encoder layers from a file written by export_network.py
+            bool load(const std::string& file_name);
+
+            // Tell if an encoder was loaded
+            bool isLoaded() const;
+
+            // Encodes a state of depth stacked frames with width x height cells (as in the transition message) into
+            // the flattened output of the last layer
+            bool encode(const std::vector<int8_t>& state, unsigned int width, unsigned int height, unsigned int depth,
+                        std::vector<float>& latent);
+
+        private:
+
+            // Applies a 'VALID' convolution and its activation on an input of rows x cols x input_size values
+            void convolve(const NetworkLayer& layer, const std::vector<float>& input, unsigned int rows,
+                          unsigned int cols, std::vector<float>& output);
+
+            std::vector<NetworkLayer> layers_;
+
+            // Buffers for the layer in- and outputs, reused for every state
+            std::vector<float> input_, output_;
+    };
+};
+#endif
@@ -0,0 +1,194 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_STATE_RASTERIZER_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_STATE_RASTERIZER_H_
+
+#include <tf/tf.h>
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace neuro_local_planner_wrapper
+{
+    // Gray value the plan saturates at far from the goal, well below the background of 50 so that the plan stays
+    // visible however long the remaining path is
+    const int PLAN_MAX_LEVEL = 30;
+
+
+    // Geometry of the state representation in the robot base frame, the inverse of the resolution is stored so that
+    // the rasterizers only need to multiply
+    struct RasterGeometry
+    {
+        int width;
+        int height;
+        double origin_x;
+        double origin_y;
+        double cells_per_meter;
+    };
+
+
+    // Draws scan points and the global plan into a state representation of Width x Height cells. For the geometries
+    // we deploy the size is a template argument, so strides and bounds are compile time constants. Width and Height 0
+    // is the generic version which takes the size from the geometry.
+    template <int Width, int Height>
+    struct StateRasterizer
+    {
+        static inline int width(const RasterGeometry& geometry)
+        {
+            return Width > 0 ? Width : geometry.width;
+        }
+
+        static inline int height(const RasterGeometry& geometry)
+        {
+            return Height > 0 ? Height : geometry.height;
+        }
+
+        // One unsigned comparison per axis also rejects negative coordinates
+        static inline bool isInside(const RasterGeometry& geometry, int x, int y)
+        {
+            return ((unsigned int)x < (unsigned int)width(geometry)) &&
+                   ((unsigned int)y < (unsigned int)height(geometry));
+        }
+
+        // Transformation from a point in the robot base frame to costmap coordinates
+        static inline void toCell(const RasterGeometry& geometry, const tf::Point& point, int& x, int& y)
+        {
+            x = (int)round((point.getX() - geometry.origin_x) * geometry.cells_per_meter - 0.5);
+            y = (int)round((point.getY() - geometry.origin_y) * geometry.cells_per_meter - 0.5);
+        }
+
+        // Marks the cells of all points, given in a fixed frame and transformed into the robot base frame, as
+        // occupied. Several hits in one cell are max pooled.
+        static void addPoints(const RasterGeometry& geometry, const std::vector<tf::Point>& points,
+                              const tf::Transform& transform, int8_t* data)
+        {
+            for (std::vector<tf::Point>::const_iterator it = points.begin(); it != points.end(); it++)
+            {
+                int x, y;
+                toCell(geometry, transform * (*it), x, y);
+
+                if (isInside(geometry, x, y))
+                {
+                    data[x + y*width(geometry)] = 100;
+                }
+            }
+        }
+
+        // Sets a plan cell if it is inside of the state representation, crossings keep the value closer to the goal
+        // and obstacles or inflated cells of the costmap are not overwritten
+        static void addPlanCell(const RasterGeometry& geometry, int x, int y, int level, int8_t* data)
+        {
+            if (isInside(geometry, x, y))
+            {
+                int8_t& cell = data[x + y*width(geometry)];
+                if (cell <= 50 && level < cell)
+                {
+                    cell = (int8_t)level;
+                }
+            }
+        }
+
+        // Draws the plan from one pose to the next one with Bresenham's line algorithm, cells closer to the goal are
+        // brighter. The level grows by one every units_per_level chamfer units up to PLAN_MAX_LEVEL.
+        static void addPlanSegment(const RasterGeometry& geometry, int x_0, int y_0, int x_1, int y_1, int& level,
+                                   int& progress, int units_per_level, int8_t* data)
+        {
+            int dx = abs(x_1 - x_0);
+            int dy = -abs(y_1 - y_0);
+
+            // Segments which lie completely on one side of the state representation are not drawn, we only need
+            // their length
+            if ((x_0 < 0 && x_1 < 0) || (y_0 < 0 && y_1 < 0) ||
+                (x_0 >= width(geometry) && x_1 >= width(geometry)) ||
+                (y_0 >= height(geometry) && y_1 >= height(geometry)))
+            {
+                int diagonal_steps = std::min(dx, -dy);
+                progress += 7*diagonal_steps + 5*(std::max(dx, -dy) - diagonal_steps);
+                while (progress >= units_per_level && level < PLAN_MAX_LEVEL)
+                {
+                    progress -= units_per_level;
+                    level++;
+                }
+                return;
+            }
+
+            int step_x = x_0 < x_1 ? 1 : -1;
+            int step_y = y_0 < y_1 ? 1 : -1;
+            int error = dx + dy;
+
+            while (x_0 != x_1 || y_0 != y_1)
+            {
+                int double_error = 2*error;
+                bool moved_x = false;
+                bool moved_y = false;
+
+                if (double_error >= dy)
+                {
+                    error += dy;
+                    x_0 += step_x;
+                    moved_x = true;
+                }
+                if (double_error <= dx)
+                {
+                    error += dx;
+                    y_0 += step_y;
+                    moved_y = true;
+                }
+
+                // a diagonal step is about 1.4 straight steps
+                progress += (moved_x && moved_y) ? 7 : 5;
+                while (progress >= units_per_level && level < PLAN_MAX_LEVEL)
+                {
+                    progress -= units_per_level;
+                    level++;
+                }
+
+                addPlanCell(geometry, x_0, y_0, level, data);
+            }
+        }
+    };
+
+
+    // Entry points of one instantiation of the rasterizer, selected once when the state geometry is known
+    struct RasterizerFunctions
+    {
+        void (*add_points)(const RasterGeometry&, const std::vector<tf::Point>&, const tf::Transform&, int8_t*);
+        void (*add_plan_cell)(const RasterGeometry&, int, int, int, int8_t*);
+        void (*add_plan_segment)(const RasterGeometry&, int, int, int, int, int&, int&, int, int8_t*);
+    };
+
+
+    template <int Width, int Height>
+    RasterizerFunctions makeRasterizerFunctions()
+    {
+        RasterizerFunctions functions;
+        functions.add_points = &StateRasterizer<Width, Height>::addPoints;
+        functions.add_plan_cell = &StateRasterizer<Width, Height>::addPlanCell;
+        functions.add_plan_segment = &StateRasterizer<Width, Height>::addPlanSegment;
+        return functions;
+    }
+
+
+    // Returns the specialized rasterizer for the deployed geometries and the generic one for all others
+    inline RasterizerFunctions selectRasterizer(int width, int height)
+    {
+        if (width == 80 && height == 80)
+        {
+            return makeRasterizerFunctions<80, 80>();
+        }
+        else if (width == 86 && height == 86)
+        {
+            return makeRasterizerFunctions<86, 86>();
+        }
+        else if (width == 128 && height == 128)
+        {
+            return makeRasterizerFunctions<128, 128>();
+        }
+        else
+        {
+            return makeRasterizerFunctions<0, 0>();
+        }
+    }
+};
+#endif
@@ -0,0 +1,123 @@
+#include <neuro_local_planner_wrapper/exploration_noise.h>
+
+#include <boost/random/variate_generator.hpp>
+
+#include <algorithm>
+
+namespace neuro_local_planner_wrapper
+{
+    // Constructor
+    ExplorationNoise::ExplorationNoise() : type_(NONE), enabled_(false), mu_(0.0), theta_(0.0), sigma_(0.0),
+                                           decay_steps_(0), sample_count_(0) {}
+
+
+    // Sets the type and the params of the noise
+    bool ExplorationNoise::configure(const std::string& type, unsigned int dimension, double mu, double theta,
+                                     double sigma, unsigned int seed)
+    {
+        if (type == "none")
+        {
+            type_ = NONE;
+        }
+        else if (type == "ou")
+        {
+            type_ = ORNSTEIN_UHLENBECK;
+        }
+        else if (type == "gaussian")
+        {
+            type_ = GAUSSIAN;
+        }
+        else
+        {
+            type_ = NONE;
+            return false;
+        }
+
+        enabled_ = true;
+        mu_ = mu;
+        theta_ = theta;
+        sigma_ = sigma;
+        sample_count_ = 0;
+        rng_.seed(seed);
+
+        state_.assign(dimension, mu_);
+        noise_.assign(dimension, 0.0);
+        return true;
+    }
+
+
+    // Fades the noise out over decay_steps samples
+    void ExplorationNoise::setDecaySteps(unsigned int decay_steps)
+    {
+        decay_steps_ = decay_steps;
+    }
+
+
+    // Switches the noise on or off
+    void ExplorationNoise::setEnabled(bool enabled)
+    {
+        enabled_ = enabled;
+    }
+
+
+    void ExplorationNoise::setSigma(double sigma)
+    {
+        sigma_ = sigma;
+    }
+
+
+    double ExplorationNoise::getSigma() const
+    {
+        return sigma_;
+    }
+
+
+    // Gives the configured type, NONE if noise can't be switched on
+    ExplorationNoise::Type ExplorationNoise::getType() const
+    {
+        return type_;
+    }
+
+
+    // Tell if noise is added to the actions
+    bool ExplorationNoise::isActive() const
+    {
+        return type_ != NONE && enabled_;
+    }
+
+
+    // Pulls the Ornstein-Uhlenbeck process back to mu
+    void ExplorationNoise::reset()
+    {
+        std::fill(state_.begin(), state_.end(), mu_);
+    }
+
+
+    // Draws the noise for the next action, the Ornstein-Uhlenbeck process moves by theta*(mu - x) + sigma*N(0, 1)
+    const std::vector<double>& ExplorationNoise::sample()
+    {
+        boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > normal(rng_, normal_);
+
+        double scale = 1.0;
+        if (decay_steps_ > 0)
+        {
+            scale = std::max(0.0, 1.0 - (double)sample_count_/decay_steps_);
+        }
+        sample_count_++;
+
+        for (unsigned int i = 0; i < noise_.size(); i++)
+        {
+            if (type_ == ORNSTEIN_UHLENBECK)
+            {
+                state_[i] += theta_*(mu_ - state_[i]) + sigma_*normal();
+                noise_[i] = scale*state_[i];
+            }
+            else
+            {
+                noise_[i] = scale*(mu_ + sigma_*normal());
+            }
+        }
+
+        return noise_;
+    }
+};
@@ -0,0 +1,38 @@
+#include <neuro_local_planner_wrapper/int8_kernels.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Plain C++ version for CPUs without AVX2
+    void multiplyInt8Scalar(const int8_t* matrix, const int8_t* vectors, unsigned int rows, unsigned int size,
+                            unsigned int count, int32_t* sums)
+    {
+        for (unsigned int v = 0; v < count; v++)
+        {
+            const int8_t* vector = vectors + v*size;
+            for (unsigned int r = 0; r < rows; r++)
+            {
+                const int8_t* row = matrix + r*size;
+                int32_t sum = 0;
+                for (unsigned int i = 0; i < size; i++)
+                {
+                    sum += (int32_t)row[i]*(int32_t)vector[i];
+                }
+                sums[v*rows + r] = sum;
+            }
+        }
+    }
+
+
+    // The AVX2 kernel is only compiled on x86, where it is also checked at runtime
+    MultiplyInt8 selectMultiplyInt8()
+    {
+#ifdef NEURO_LOCAL_PLANNER_WRAPPER_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return &multiplyInt8Avx2;
+        }
+#endif
+        return &multiplyInt8Scalar;
+    }
+};
@@ -0,0 +1,72 @@
+#include <neuro_local_planner_wrapper/int8_kernels.h>
+
+#include <immintrin.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Helper function to add up the 8 lanes of a sum
+    static inline int32_t horizontalSum(__m256i sum)
+    {
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_hadd_epi32(half, half);
+        half = _mm_hadd_epi32(half, half);
+        return _mm_cvtsi128_si32(half);
+    }
+
+
+    // Helper function to sign extend 16 int8 values to int16
+    static inline __m256i load16(const int8_t* values)
+    {
+        return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+    }
+
+
+    // Sign extends 16 int8 values of a row and of the vectors to int16, multiplies them and adds neighbouring
+    // products to 8 int32 sums (madd), so there is no overflow for the int8 range. Each block of a row is loaded once
+    // for four vectors.
+    void multiplyInt8Avx2(const int8_t* matrix, const int8_t* vectors, unsigned int rows, unsigned int size,
+                          unsigned int count, int32_t* sums)
+    {
+        for (unsigned int r = 0; r < rows; r++)
+        {
+            const int8_t* row = matrix + r*size;
+
+            unsigned int v = 0;
+            for (; v + 4 <= count; v += 4)
+            {
+                const int8_t* vector = vectors + v*size;
+                __m256i sum_0 = _mm256_setzero_si256();
+                __m256i sum_1 = _mm256_setzero_si256();
+                __m256i sum_2 = _mm256_setzero_si256();
+                __m256i sum_3 = _mm256_setzero_si256();
+
+                for (unsigned int i = 0; i < size; i += INT8_BLOCK_SIZE)
+                {
+                    __m256i a = load16(row + i);
+                    sum_0 = _mm256_add_epi32(sum_0, _mm256_madd_epi16(a, load16(vector + i)));
+                    sum_1 = _mm256_add_epi32(sum_1, _mm256_madd_epi16(a, load16(vector + size + i)));
+                    sum_2 = _mm256_add_epi32(sum_2, _mm256_madd_epi16(a, load16(vector + 2*size + i)));
+                    sum_3 = _mm256_add_epi32(sum_3, _mm256_madd_epi16(a, load16(vector + 3*size + i)));
+                }
+
+                sums[v*rows + r] = horizontalSum(sum_0);
+                sums[(v + 1)*rows + r] = horizontalSum(sum_1);
+                sums[(v + 2)*rows + r] = horizontalSum(sum_2);
+                sums[(v + 3)*rows + r] = horizontalSum(sum_3);
+            }
+
+            for (; v < count; v++)
+            {
+                const int8_t* vector = vectors + v*size;
+                __m256i sum = _mm256_setzero_si256();
+
+                for (unsigned int i = 0; i < size; i += INT8_BLOCK_SIZE)
+                {
+                    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(load16(row + i), load16(vector + i)));
+                }
+
+                sums[v*rows + r] = horizontalSum(sum);
+            }
+        }
+    }
+};
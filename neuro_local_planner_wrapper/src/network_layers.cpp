@@ -0,0 +1,110 @@
+#include <neuro_local_planner_wrapper/network_layers.h>
+
+#include <ros/ros.h>
+
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+
+namespace neuro_local_planner_wrapper
+{
+    // Helper function to read little endian values as they are written by export_network.py
+    template <typename T>
+    static bool readValues(std::ifstream& file, T* values, size_t count)
+    {
+        file.read(reinterpret_cast<char*>(values), sizeof(T)*count);
+        return file.good();
+    }
+
+
+    // Reads all layers of a network file
+    bool loadNetworkLayers(const std::string& file_name, std::vector<NetworkLayer>& layers)
+    {
+        layers.clear();
+
+        std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open())
+        {
+            ROS_ERROR("Could not open network file %s", file_name.c_str());
+            return false;
+        }
+
+        // header: magic, version, number of layers
+        char magic[8];
+        uint32_t header[2];
+        if (!readValues(file, magic, 8) || strncmp(magic, "NEURONET", 8) != 0 || !readValues(file, header, 2) ||
+            header[0] != 1)
+        {
+            ROS_ERROR("%s is not a network file of version 1", file_name.c_str());
+            return false;
+        }
+
+        layers.resize(header[1]);
+        for (unsigned int i = 0; i < layers.size(); i++)
+        {
+            // type, activation, kernel size, stride, input size, output size
+            uint32_t description[6];
+            if (!readValues(file, description, 6))
+            {
+                ROS_ERROR("Network file %s ends in layer %u", file_name.c_str(), i);
+                layers.clear();
+                return false;
+            }
+
+            // A broken description would make the weights below or the layers later read out of bounds
+            if (description[0] > NetworkLayer::FULLY_CONNECTED || description[1] > NetworkLayer::RELU)
+            {
+                ROS_ERROR("Layer %u of the network file %s has the unknown type %u or activation %u", i,
+                          file_name.c_str(), description[0], description[1]);
+                layers.clear();
+                return false;
+            }
+
+            if (description[4] == 0 || description[5] == 0 ||
+                (description[0] == NetworkLayer::CONVOLUTION && (description[2] == 0 || description[3] == 0)))
+            {
+                ROS_ERROR("Layer %u of the network file %s has an empty kernel, stride, input or output", i,
+                          file_name.c_str());
+                layers.clear();
+                return false;
+            }
+
+            // The outputs of a layer are the inputs of the next one of the same type, the inputs of the first
+            // fully connected layer depend on the size of the state and are checked when it is known
+            if (i > 0 && description[0] == (uint32_t)layers[i - 1].type &&
+                description[4] != layers[i - 1].output_size)
+            {
+                ROS_ERROR("Layer %u of the network file %s takes %u inputs but layer %u has %u outputs", i,
+                          file_name.c_str(), description[4], i - 1, layers[i - 1].output_size);
+                layers.clear();
+                return false;
+            }
+
+            NetworkLayer& layer = layers[i];
+            layer.type = (NetworkLayer::Type)description[0];
+            layer.activation = (NetworkLayer::Activation)description[1];
+            layer.kernel_size = description[2];
+            layer.stride = description[3];
+            layer.input_size = description[4];
+            layer.output_size = description[5];
+
+            size_t weight_count = (size_t)layer.input_size*layer.output_size;
+            if (layer.type == NetworkLayer::CONVOLUTION)
+            {
+                weight_count *= layer.kernel_size*layer.kernel_size;
+            }
+
+            layer.weights.resize(weight_count);
+            layer.biases.resize(layer.output_size);
+            if (!readValues(file, &layer.weights[0], layer.weights.size()) ||
+                !readValues(file, &layer.biases[0], layer.biases.size()))
+            {
+                ROS_ERROR("Network file %s ends in layer %u", file_name.c_str(), i);
+                layers.clear();
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
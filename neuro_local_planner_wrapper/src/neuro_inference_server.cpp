@@ -0,0 +1,219 @@
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <neuro_local_planner_wrapper/Transition.h>
+#include <neuro_local_planner_wrapper/quantized_policy.h>
+
+#include <boost/bind.hpp>
+
+#include <string>
+#include <vector>
+
+namespace neuro_local_planner_wrapper
+{
+    // Runs the int8 actor for many robots at once. The transitions of all wrappers are collected until every robot
+    // sent one or the batch window since the first of them is over, then the actions of the whole batch are computed
+    // in one forward pass and sent back to each robot.
+    class NeuroInferenceServer
+    {
+        public:
+
+            // Constructor
+            NeuroInferenceServer();
+
+            // Loads the policy and connects to the wrappers of all robots
+            bool initialize();
+
+        private:
+
+            // Callback function for the subscriber to the transitions of a robot
+            void callbackTransition(const neuro_local_planner_wrapper::Transition::ConstPtr& transition,
+                                    unsigned int robot);
+
+            // Callback function for the end of the batch window
+            void callbackBatchWindow(const ros::TimerEvent& event);
+
+            // Computes and sends the actions for all pending transitions
+            void runBatch();
+
+            ros::NodeHandle nh_;
+            ros::NodeHandle private_nh_;
+
+            // Namespaces of the robots and their topics
+            std::vector<std::string> robots_;
+            std::vector<ros::Subscriber> transition_subs_;
+            std::vector<ros::Publisher> action_pubs_;
+
+            // Latest transition of each robot which has not got its action yet
+            std::vector<neuro_local_planner_wrapper::Transition::ConstPtr> pending_;
+            unsigned int pending_count_;
+
+            // Started by the first pending transition, runs the batch even if not all robots sent one
+            ros::Timer batch_timer_;
+            double batch_window_;
+
+            QuantizedPolicy policy_;
+
+            // Buffers for the batch, reused for every batch
+            std::vector<const std::vector<int8_t>*> batch_states_;
+            std::vector<unsigned int> batch_robots_;
+            std::vector<std::vector<float> > batch_actions_;
+    };
+
+
+    // Constructor
+    NeuroInferenceServer::NeuroInferenceServer() : private_nh_("~"), pending_count_(0), batch_window_(0.01) {}
+
+
+    // Loads the policy and connects to the wrappers of all robots
+    bool NeuroInferenceServer::initialize()
+    {
+        std::string policy_file;
+        private_nh_.param("policy_file", policy_file, std::string(""));
+        if (policy_file.empty() || !policy_.load(policy_file))
+        {
+            ROS_ERROR("Failed to load the policy from '%s'", policy_file.c_str());
+            return false;
+        }
+
+        // How long do we wait for the transitions of the other robots after the first one?
+        private_nh_.param("batch_window", batch_window_, 0.01);
+
+        // Without a list of robots we serve the single robot in the global namespace
+        private_nh_.getParam("robots", robots_);
+        if (robots_.empty())
+        {
+            robots_.push_back("");
+        }
+
+        pending_.resize(robots_.size());
+        for (unsigned int i = 0; i < robots_.size(); i++)
+        {
+            std::string prefix = robots_[i].empty() ? "" : "/" + robots_[i];
+
+            transition_subs_.push_back(nh_.subscribe<neuro_local_planner_wrapper::Transition>(
+                prefix + "/move_base/NeuroLocalPlannerWrapper/transition", 1,
+                boost::bind(&NeuroInferenceServer::callbackTransition, this, _1, i)));
+
+            action_pubs_.push_back(nh_.advertise<geometry_msgs::Twist>(prefix + "/neuro_deep_planner/action", 1));
+        }
+
+        batch_timer_ = private_nh_.createTimer(ros::Duration(batch_window_),
+                                               &NeuroInferenceServer::callbackBatchWindow, this, true, false);
+
+        ROS_INFO("Serving %lu robots with a batch window of %f s", robots_.size(), batch_window_);
+        return true;
+    }
+
+
+    // Callback function for the subscriber to the transitions of a robot, a newer transition replaces a pending one
+    void NeuroInferenceServer::callbackTransition(const neuro_local_planner_wrapper::Transition::ConstPtr& transition,
+                                                  unsigned int robot)
+    {
+        // The wrapper does not need an action at the end of an episode, and a state which was replaced by its latent
+        // code can not be fed to the actor
+        if (transition->is_episode_finished)
+        {
+            return;
+        }
+
+        if (transition->state_representation.empty())
+        {
+            ROS_WARN_ONCE("Got a transition without state, don't set latent_only in the wrapper for the server");
+            return;
+        }
+
+        if (!pending_[robot])
+        {
+            pending_count_++;
+        }
+        pending_[robot] = transition;
+
+        if (pending_count_ == robots_.size())
+        {
+            batch_timer_.stop();
+            runBatch();
+        }
+        else if (pending_count_ == 1)
+        {
+            batch_timer_.stop();
+            batch_timer_.start();
+        }
+    }
+
+
+    // Callback function for the end of the batch window
+    void NeuroInferenceServer::callbackBatchWindow(const ros::TimerEvent& event)
+    {
+        if (pending_count_ > 0)
+        {
+            runBatch();
+        }
+    }
+
+
+    // Computes and sends the actions for all pending transitions, states of a different size than the first one go
+    // into another batch
+    void NeuroInferenceServer::runBatch()
+    {
+        while (pending_count_ > 0)
+        {
+            batch_states_.clear();
+            batch_robots_.clear();
+
+            unsigned int width = 0, height = 0, depth = 0;
+            for (unsigned int i = 0; i < pending_.size(); i++)
+            {
+                if (!pending_[i])
+                {
+                    continue;
+                }
+
+                if (batch_states_.empty())
+                {
+                    width = pending_[i]->width;
+                    height = pending_[i]->height;
+                    depth = pending_[i]->depth;
+                }
+                else if (pending_[i]->width != width || pending_[i]->height != height || pending_[i]->depth != depth)
+                {
+                    continue;
+                }
+
+                batch_states_.push_back(&pending_[i]->state_representation);
+                batch_robots_.push_back(i);
+            }
+
+            bool is_computed = policy_.actBatch(batch_states_, width, height, depth, batch_actions_);
+
+            for (unsigned int b = 0; b < batch_robots_.size(); b++)
+            {
+                unsigned int robot = batch_robots_[b];
+                if (is_computed && batch_actions_[b].size() >= 2)
+                {
+                    geometry_msgs::Twist action;
+                    action.linear.x = batch_actions_[b][0];
+                    action.linear.y = batch_actions_[b][1];
+                    action_pubs_[robot].publish(action);
+                }
+
+                pending_[robot].reset();
+                pending_count_--;
+            }
+        }
+    }
+};
+
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "neuro_inference_server");
+
+    neuro_local_planner_wrapper::NeuroInferenceServer server;
+    if (!server.initialize())
+    {
+        return 1;
+    }
+
+    ros::spin();
+    return 0;
+}
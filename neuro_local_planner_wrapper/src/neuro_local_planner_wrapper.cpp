@@ -1,11 +1,11 @@
 #include <neuro_local_planner_wrapper/neuro_local_planner_wrapper.h>
 #include <pluginlib/class_list_macros.h>
 
+#include <boost/functional/hash.hpp>
+
 // Register this planner as a BaseLocalPlanner plugin
 PLUGINLIB_EXPORT_CLASS(neuro_local_planner_wrapper::NeuroLocalPlannerWrapper, nav_core::BaseLocalPlanner)
 
-double goalTolerance = 0.2;
-
 
 namespace neuro_local_planner_wrapper
 {
@@ -38,8 +38,7 @@ namespace neuro_local_planner_wrapper
 
             state_pub_ = private_nh.advertise<std_msgs::Bool>("new_round", 1);
 
-            laser_scan_sub_ = private_nh.subscribe("/scan", 1000, &NeuroLocalPlannerWrapper::buildStateRepresentation,
-                                                   this);
+            laser_scan_sub_ = private_nh.subscribe("/scan", 1000, &NeuroLocalPlannerWrapper::callbackLaserScan, this);
 
             customized_costmap_pub_ = private_nh.advertise<nav_msgs::OccupancyGrid>("customized_costmap", 1);
 
@@ -47,23 +46,32 @@ namespace neuro_local_planner_wrapper
 
             action_pub_ = private_nh.advertise<geometry_msgs::Twist>("action", 1);
 
-            noise_flag_pub_ = private_nh.advertise<std_msgs::Bool>("/noise_flag", 1);
+            noise_flag_pub_ = private_nh.advertise<std_msgs::Bool>("/noise_flag", 1, true);
 
-            action_sub_ = private_nh.subscribe("/neuro_deep_planner/action", 1000,
-                                               &NeuroLocalPlannerWrapper::callbackAction, this);
+            // The actions come from the planning node or, with many robots, from neuro_inference_server
+            std::string action_topic;
+            private_nh.param("action_topic", action_topic, std::string("/neuro_deep_planner/action"));
+            action_sub_ = private_nh.subscribe(action_topic, 1000, &NeuroLocalPlannerWrapper::callbackAction, this);
 
-            // Setup tf
+            // Setup tf, the listener of move_base is only handed on to the wrapped planner, our own lookups go through
+            // a tf2 buffer
             tf_ = tf;
+            tf_listener_.reset(new tf2_ros::TransformListener(tf_buffer_));
 
             // Setup the costmap_ros interface
             costmap_ros_ = costmap_ros;
             costmap_ros_->getRobotPose(current_pose_);
 
+            // Odometry for the velocity features
+            std::string odom_topic;
+            private_nh.param("odom_topic", odom_topic, std::string("odom"));
+            odom_helper_.setOdomTopic(odom_topic);
+
             // Get the actual costmap object
             costmap_ = costmap_ros_->getCostmap();
 
             // Initialize customized costmap and transition message
-            initializeCustomizedCostmap();
+            initializeCustomizedCostmap(private_nh);
             initializeTransitionMsg();
 
             // initialize action to zero until first velocity command is computed
@@ -74,8 +82,32 @@ namespace neuro_local_planner_wrapper
             existing_plugin_ = false;
             std::string local_planner = "dwa_local_planner/DWAPlannerROS";
 
-            // If we want to, lets load a local planner plugin to do the work for us
-            if (existing_plugin_)
+            // What should we do if the planning node misses the deadline for its next action?
+            std::string action_fallback;
+            private_nh.param("action_deadline", action_deadline_, 0.5);
+            private_nh.param("action_fallback", action_fallback, std::string("hold"));
+            private_nh.param("action_decay", action_decay_, 0.5);
+            if (action_fallback == "decay")
+            {
+                action_fallback_ = DECAY;
+            }
+            else if (action_fallback == "plugin")
+            {
+                action_fallback_ = PLUGIN;
+            }
+            else
+            {
+                action_fallback_ = HOLD;
+            }
+            action_applied_stamp_ = ros::Time::now();
+            transition_stamp_ = action_applied_stamp_;
+            is_action_pending_ = false;
+            is_deadline_missed_ = false;
+            deadline_miss_count_ = 0;
+            is_deadline_missed_since_transition_ = false;
+
+            // If we want to, lets load a local planner plugin to do the work for us, also needed as fallback
+            if (existing_plugin_ || action_fallback_ == PLUGIN)
             {
                 try
                 {
@@ -105,6 +137,123 @@ namespace neuro_local_planner_wrapper
 
             // To close up too long episodes
             max_time_ = 60;
+            start_time_ = ros::Time::now().toSec();
+
+            // Distance to the goal at which an episode is finished
+            private_nh.param("goal_tolerance", goal_tolerance_, 0.2);
+            goal_robot_base_frame_.setZero();
+            is_goal_known_ = false;
+
+            // Path length over which the gray value of the global plan fades from the goal to its darkest value
+            private_nh.param("plan_gradient_length", plan_gradient_length_,
+                             customized_costmap_.info.width*(double)customized_costmap_.info.resolution);
+
+            // Should we encode the state before sending it to the planning node? The state is only dropped from the
+            // transitions if the consumer acts on the latent code, the planning node needs the full state.
+            std::string encoder_file;
+            private_nh.param("encoder_file", encoder_file, std::string(""));
+            private_nh.param("latent_only", latent_only_, false);
+            private_nh.param("raw_frame_interval", raw_frame_interval_, 100);
+            transitions_since_raw_frame_ = 0;
+            if (!encoder_file.empty() && !state_encoder_.load(encoder_file))
+            {
+                ROS_ERROR("Failed to load the encoder, sending the full state representation");
+            }
+
+            // Should we drive with the int8 policy instead of waiting for the actions of the planning node?
+            std::string policy_file;
+            private_nh.param("policy_file", policy_file, std::string(""));
+            if (!policy_file.empty() && !policy_.load(policy_file))
+            {
+                ROS_ERROR("Failed to load the policy, waiting for the actions of the planning node");
+            }
+
+            // Should we copy the local costmap instead of drawing the laser scans?
+            std::string state_source;
+            private_nh.param("state_source", state_source, std::string("laser"));
+            costmap_state_ = (state_source == "costmap");
+            initializeCostTranslationTable();
+
+            // Should we detect collisions with the laser scans or take them from the simulator instead of the local
+            // costmap?
+            std::string collision_source;
+            double crash_padding;
+            private_nh.param("collision_source", collision_source, std::string("costmap"));
+            private_nh.param("crash_padding", crash_padding, 0.05);
+            scan_collision_ = (collision_source == "scan");
+            initializeFootprintMask(crash_padding);
+
+            simulator_collision_ = (collision_source == "simulator");
+            resetContact();
+            private_nh.param("crash_clearance", crash_clearance_, 0.0);
+            if (simulator_collision_)
+            {
+                std::string contact_topic;
+                private_nh.param("contact_topic", contact_topic, std::string("/contact"));
+                contact_sub_ = private_nh.subscribe(contact_topic, 1, &NeuroLocalPlannerWrapper::callbackContact,
+                                                    this);
+            }
+
+            // Frames are built at this rate and pool all laser scans received in between
+            private_nh.param("state_rate", state_rate_, 0.0);
+            last_frame_stamp_ = ros::Time(0);
+
+            // The planning node only decides every action_repeat-th state, in between the action is held and the
+            // rewards are summed up
+            private_nh.param("action_repeat", action_repeat_, 1);
+            action_repeat_ = std::max(1, action_repeat_);
+            frames_since_decision_ = 0;
+            accumulated_reward_ = 0.0;
+
+            // Should we build the state in the control cycle of move_base and return the action computed for it
+            // instead of building it for every laser scan and sending the actions directly?
+            private_nh.param("sync_to_control", sync_to_control_, false);
+            private_nh.param("action_timeout", action_timeout_, 0.05);
+            action_count_ = 0;
+
+            // Checks the age of the last action
+            if (action_deadline_ > 0.0)
+            {
+                action_watchdog_timer_ = private_nh.createTimer(ros::Duration(action_deadline_/2.0),
+                                                                &NeuroLocalPlannerWrapper::callbackActionWatchdog,
+                                                                this);
+            }
+
+            // Should we only build states once the planning node signals that it is ready?
+            private_nh.param("wait_for_agent_ready", wait_for_agent_ready_, false);
+            agent_ready_ = false;
+            agent_ready_sub_ = private_nh.subscribe("/neuro_deep_planner/agent_ready", 1,
+                                                    &NeuroLocalPlannerWrapper::callbackAgentReady, this);
+
+            // Should we add exploration noise ("none", "ou" or "gaussian") to the actions of the network ourselves?
+            // Each robot gets its own random numbers, seeded from its namespace unless a seed is given.
+            std::string exploration_noise;
+            double noise_mu, noise_theta, noise_sigma;
+            int noise_seed, noise_decay_steps;
+            private_nh.param("exploration_noise", exploration_noise, std::string("none"));
+            private_nh.param("noise_mu", noise_mu, 0.0);
+            private_nh.param("noise_theta", noise_theta, 0.15);
+            private_nh.param("noise_sigma", noise_sigma, 0.2);
+            private_nh.param("noise_seed", noise_seed, (int)boost::hash<std::string>()(private_nh.getNamespace()));
+            private_nh.param("noise_decay_steps", noise_decay_steps, 0);
+            private_nh.param("noise_action_bound", noise_action_bound_, 0.4);
+            if (!exploration_noise_.configure(exploration_noise, 2, noise_mu, noise_theta, noise_sigma,
+                                              (unsigned int)noise_seed))
+            {
+                ROS_ERROR("Unknown exploration noise '%s', not adding any", exploration_noise.c_str());
+            }
+            exploration_noise_.setDecaySteps((unsigned int)std::max(noise_decay_steps, 0));
+            exploration_noise_srv_ = private_nh.advertiseService("set_exploration_noise",
+                                                                 &NeuroLocalPlannerWrapper::callbackSetExplorationNoise,
+                                                                 this);
+
+            // The planning node must not add its own noise on top of ours
+            if (exploration_noise_.isActive())
+            {
+                std_msgs::Bool noise_flag;
+                noise_flag.data = false;
+                noise_flag_pub_.publish(noise_flag);
+            }
 
             // We are now initialized
             initialized_ = true;
@@ -126,13 +275,15 @@ namespace neuro_local_planner_wrapper
             return false;
         }
 
+        boost::mutex::scoped_lock lock(state_mutex_);
+
         // Safe the global plan
         global_plan_.clear();
         global_plan_ = orig_global_plan;
 
         // If we use the dwa:
         // This code is copied from the dwa_planner
-        if (existing_plugin_)
+        if (tc_)
         {
             if (!tc_->setPlan(orig_global_plan))
             {
@@ -141,8 +292,21 @@ namespace neuro_local_planner_wrapper
             }
         }
 
+        // A plan while no episode runs starts a new one, which gets a fresh noise process. Replanning during an
+        // episode keeps the noise, so it stays correlated in time.
+        bool is_new_episode = !is_running_;
         is_running_ = true;
 
+        // The deadline only runs once the first transition of the episode is published
+        boost::mutex::scoped_lock action_lock(action_mutex_);
+        is_action_pending_ = false;
+        is_deadline_missed_ = false;
+        if (is_new_episode)
+        {
+            exploration_noise_.reset();
+            is_deadline_missed_since_transition_ = false;
+        }
+
         return true;
     }
 
@@ -150,6 +314,58 @@ namespace neuro_local_planner_wrapper
     // Compute the velocity commands
     bool NeuroLocalPlannerWrapper::computeVelocityCommands(geometry_msgs::Twist& cmd_vel)
     {
+        // Otherwise the states are built in the laser scan callback and the actions are sent directly to the robot
+        if (!sync_to_control_)
+        {
+            return true;
+        }
+
+        // Take the laser scans received since the last control cycle
+        std::deque<sensor_msgs::LaserScan::ConstPtr> laser_scans;
+        {
+            boost::mutex::scoped_lock lock(scan_mutex_);
+            laser_scans.swap(pending_scans_);
+        }
+
+        unsigned int action_count;
+        {
+            boost::mutex::scoped_lock lock(action_mutex_);
+            action_count = action_count_;
+        }
+
+        // Build the state for this control cycle from the latest scan, the ones before it may still end the episode
+        // and their points show up in the frame
+        bool is_transition_published = false;
+        if (!laser_scans.empty())
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            uint32_t seq = transition_msg_.header.seq;
+            for (unsigned int i = 0; i < laser_scans.size(); i++)
+            {
+                buildStateRepresentation(*laser_scans[i], i + 1 == laser_scans.size());
+            }
+            is_transition_published = is_running_ && transition_msg_.header.seq != seq;
+        }
+
+        // Wait a bounded time for the action the planning node computes for this state, otherwise we keep the last one
+        boost::mutex::scoped_lock lock(action_mutex_);
+        if (is_transition_published)
+        {
+            boost::system_time deadline = boost::get_system_time() +
+                                          boost::posix_time::microseconds((int64_t)(action_timeout_*1e6));
+            while (action_count_ == action_count)
+            {
+                if (!action_condition_.timed_wait(lock, deadline))
+                {
+                    ROS_WARN_THROTTLE(1.0, "No action received within %f s, keeping the last one", action_timeout_);
+                    break;
+                }
+            }
+        }
+
+        cmd_vel = action_;
+        publishAction();
+
         return true;
     }
 
@@ -162,7 +378,7 @@ namespace neuro_local_planner_wrapper
 
 
     // Helper function to initialize the state representation
-    void NeuroLocalPlannerWrapper::initializeCustomizedCostmap()
+    void NeuroLocalPlannerWrapper::initializeCustomizedCostmap(ros::NodeHandle& private_nh)
     {
         customized_costmap_ = nav_msgs::OccupancyGrid();
 
@@ -171,17 +387,32 @@ namespace neuro_local_planner_wrapper
         customized_costmap_.header.stamp = ros::Time::now();
         customized_costmap_.header.seq = 0;
 
-        // info
-        customized_costmap_.info.width = costmap_->getSizeInCellsX(); // e.g. 80
-        customized_costmap_.info.height = costmap_->getSizeInCellsY(); // e.g. 80
-        customized_costmap_.info.resolution = (float)costmap_->getResolution(); // e.g. 0.05
-        customized_costmap_.info.origin.position.x = -costmap_->getSizeInMetersX()/2.0; // e.g.-1.95
-        customized_costmap_.info.origin.position.y = -costmap_->getSizeInMetersY()/2.0; // e.g.-1.95
+        // info, by default the size of the local costmap but can be set independently so that the local costmap can be
+        // slowed down or turned off
+        int width, height;
+        double resolution;
+        private_nh.param("state_width", width, (int)costmap_->getSizeInCellsX());
+        private_nh.param("state_height", height, (int)costmap_->getSizeInCellsY());
+        private_nh.param("state_resolution", resolution, costmap_->getResolution());
+
+        customized_costmap_.info.width = width; // e.g. 80
+        customized_costmap_.info.height = height; // e.g. 80
+        customized_costmap_.info.resolution = (float)resolution; // e.g. 0.05
+        customized_costmap_.info.origin.position.x = -width*resolution/2.0; // e.g.-1.95
+        customized_costmap_.info.origin.position.y = -height*resolution/2.0; // e.g.-1.95
         customized_costmap_.info.origin.position.z = 0.01; // looks better in simulation
         customized_costmap_.info.origin.orientation.x = 0.0;
         customized_costmap_.info.origin.orientation.y = 0.0;
         customized_costmap_.info.origin.orientation.z = 0.0;
         customized_costmap_.info.origin.orientation.w = 1.0;
+
+        // The rasterizer is specialized for the size of the state representation
+        raster_geometry_.width = width;
+        raster_geometry_.height = height;
+        raster_geometry_.origin_x = customized_costmap_.info.origin.position.x;
+        raster_geometry_.origin_y = customized_costmap_.info.origin.position.y;
+        raster_geometry_.cells_per_meter = 1.0 / customized_costmap_.info.resolution;
+        rasterizer_ = selectRasterizer(width, height);
     }
 
 
@@ -203,6 +434,8 @@ namespace neuro_local_planner_wrapper
     // Is called during construction and before the robot is beamed to a new place
     void NeuroLocalPlannerWrapper::setZeroAction()
     {
+        boost::mutex::scoped_lock lock(action_mutex_);
+
         action_.linear.x = 0.0;
         action_.linear.y = 0.0;
         action_.linear.z = 0.0;
@@ -210,25 +443,49 @@ namespace neuro_local_planner_wrapper
         action_.angular.y = 0.0;
         action_.angular.z = 0.0;
 
+        publishAction();
+    }
+
+
+    // Sends the action to the robot and remembers when it was applied, the action mutex must be locked
+    void NeuroLocalPlannerWrapper::publishAction()
+    {
         action_pub_.publish(action_);
+        action_applied_stamp_ = ros::Time::now();
     }
 
 
     // Checks if the robot is in collision or not
-    bool NeuroLocalPlannerWrapper::isCrashed(double& reward)
+    bool NeuroLocalPlannerWrapper::isCrashed(const sensor_msgs::LaserScan& laser_scan, double& reward)
     {
         // Get current position of robot
         costmap_ros_->getRobotPose(current_pose_); // in frame odom
 
-        // Compute map coordinates
-        int robot_x;
-        int robot_y;
-        costmap_->worldToMapNoBounds(current_pose_.getOrigin().getX(), current_pose_.getOrigin().getY(), robot_x,
-                                     robot_y);
+        bool crashed;
+        if (simulator_collision_)
+        {
+            // A contact stamped before the scan belongs to an earlier step, the simulator publishes the contact of a
+            // step before its scans
+            crashed = contact_stamp_ >= laser_scan.header.stamp && (is_stalled_ || min_clearance_ < crash_clearance_);
+        }
+        else if (scan_collision_)
+        {
+            crashed = isFootprintHit(laser_scan);
+        }
+        else
+        {
+            // Compute map coordinates
+            int robot_x;
+            int robot_y;
+            costmap_->worldToMapNoBounds(current_pose_.getOrigin().getX(), current_pose_.getOrigin().getY(),
+                                         robot_x, robot_y);
+
+            // This causes a crash not just a critical positions but a little bit before the wall
+            // TODO: could be solved nicer by using a different inscribed radius, then: >= 253
+            crashed = costmap_->getCost((unsigned int)robot_x, (unsigned int)robot_y) >= 170;
+        }
 
-        // This causes a crash not just a critical positions but a little bit before the wall
-        // TODO: could be solved nicer by using a different inscribed radius, then: >= 253
-        if(costmap_->getCost((unsigned int)robot_x, (unsigned int)robot_y) >= 170)
+        if(crashed)
         {
             crash_counter_++;
             ROS_INFO("We crashed: %d", crash_counter_);
@@ -251,17 +508,11 @@ namespace neuro_local_planner_wrapper
         // Get goal position
         geometry_msgs::PoseStamped goal_position = global_plan_.back();
 
-        // Transform current position of robot to map frame
-        tf::StampedTransform stamped_transform;
-        try
-        {
-            // ros::Time(0) gives us the latest available transform
-            tf_->lookupTransform(goal_position.header.frame_id, current_pose_.frame_id_, ros::Time(0),
-                                 stamped_transform);
-        }
-        catch (tf::TransformException ex)
+        // Transform current position of robot to map frame, without it we can't tell the distance to the goal
+        tf::Transform stamped_transform;
+        if (!lookupTransform(goal_position.header.frame_id, current_pose_.frame_id_, stamped_transform))
         {
-            ROS_ERROR("%s",ex.what());
+            return false;
         }
 
         // Translation TODO: WHYYY? + -> -
@@ -282,7 +533,7 @@ namespace neuro_local_planner_wrapper
                            + pow((y_current_pose_map_frame - goal_position.pose.position.y), 2.0));
 
         // Check if the robot has reached the goal
-        if(dist < goalTolerance)
+        if(dist < goal_tolerance_)
         {
             goal_counter_++;
             ROS_INFO("We reached the goal: %d", goal_counter_);
@@ -299,11 +550,17 @@ namespace neuro_local_planner_wrapper
     // Publishes the action which is executed by the robot
     void NeuroLocalPlannerWrapper::callbackAction(geometry_msgs::Twist action)
     {
+        boost::mutex::scoped_lock lock(action_mutex_);
+
+        is_action_pending_ = false;
+        is_deadline_missed_ = false;
+
         // Should we use the network as a planner or the dwa planner?
         if (!existing_plugin_)
         {
             // Get action from net
             action_ = action;
+            addExplorationNoise(action_);
         }
         else
         {
@@ -321,20 +578,205 @@ namespace neuro_local_planner_wrapper
             }
         }
 
+        // In sync mode the action is sent in the next control cycle which waits for it
+        if (sync_to_control_)
+        {
+            action_count_++;
+            action_condition_.notify_all();
+            return;
+        }
+
         // Publish
-        action_pub_.publish(action_);
+        publishAction();
+    }
+
+
+    // Replaces the last action if the planning node missed the deadline for its reply to the last transition, so
+    // the robot does not execute it forever. Without an outstanding transition the last action is valid however long
+    // ago it came, e.g. during action repeat or with a low state rate.
+    void NeuroLocalPlannerWrapper::callbackActionWatchdog(const ros::TimerEvent&)
+    {
+        boost::mutex::scoped_lock lock(action_mutex_);
+
+        if (!is_running_ || !is_action_pending_ ||
+            ros::Time::now() - transition_stamp_ < ros::Duration(action_deadline_))
+        {
+            return;
+        }
+
+        if (!is_deadline_missed_)
+        {
+            is_deadline_missed_ = true;
+            is_deadline_missed_since_transition_ = true;
+            deadline_miss_count_++;
+            ROS_WARN("No action received %f s after the transition, deadline misses: %d", action_deadline_,
+                     deadline_miss_count_);
+        }
+
+        if (action_fallback_ == DECAY)
+        {
+            action_.linear.x *= action_decay_;
+            action_.linear.y *= action_decay_;
+            action_.angular.z *= action_decay_;
+        }
+        else if (action_fallback_ == PLUGIN)
+        {
+            geometry_msgs::Twist cmd;
+            if (tc_ && tc_->computeVelocityCommands(cmd))
+            {
+                action_ = cmd;
+            }
+            else
+            {
+                ROS_ERROR("Plugin failed computing a command");
+            }
+        }
+        else
+        {
+            // hold the last action
+            return;
+        }
+
+        // In sync mode the action is sent in the next control cycle
+        if (!sync_to_control_)
+        {
+            publishAction();
+        }
+    }
+
+
+    // Callback function for the service to switch the exploration noise on or off, which only works if a type of
+    // noise was configured at startup
+    bool NeuroLocalPlannerWrapper::callbackSetExplorationNoise(
+        neuro_local_planner_wrapper::SetExplorationNoise::Request& request,
+        neuro_local_planner_wrapper::SetExplorationNoise::Response& response)
+    {
+        boost::mutex::scoped_lock lock(action_mutex_);
+
+        if (exploration_noise_.getType() == ExplorationNoise::NONE)
+        {
+            ROS_WARN("No exploration noise configured, set the parameter exploration_noise to use the service");
+            response.success = false;
+            return true;
+        }
+
+        exploration_noise_.setEnabled(request.enabled);
+        if (request.sigma > 0.0)
+        {
+            exploration_noise_.setSigma(request.sigma);
+        }
+        exploration_noise_.reset();
+
+        // The planning node adds its own noise exactly while we don't
+        std_msgs::Bool noise_flag;
+        noise_flag.data = !exploration_noise_.isActive();
+        noise_flag_pub_.publish(noise_flag);
+
+        ROS_INFO("Exploration noise %s with sigma %f", request.enabled ? "on" : "off", exploration_noise_.getSigma());
+        response.success = true;
+        return true;
+    }
+
+
+    // Adds the exploration noise to an action of the network and scales it back into the action bounds as ddpg.py
+    // does, the noise is kept for the transition. Called with the action mutex held.
+    void NeuroLocalPlannerWrapper::addExplorationNoise(geometry_msgs::Twist& action)
+    {
+        if (!exploration_noise_.isActive())
+        {
+            action_noise_.clear();
+            return;
+        }
+
+        const std::vector<double>& noise = exploration_noise_.sample();
+        action.linear.x += noise[0];
+        action.linear.y += noise[1];
+
+        if (noise_action_bound_ > 0.0)
+        {
+            double max_value = std::max(fabs(action.linear.x), fabs(action.linear.y));
+            if (max_value > noise_action_bound_)
+            {
+                action.linear.x *= noise_action_bound_/max_value;
+                action.linear.y *= noise_action_bound_/max_value;
+            }
+        }
+
+        action_noise_.assign(noise.begin(), noise.end());
+    }
+
+
+    // Callback function for the subscriber to the ground truth contact of the simulator
+    void NeuroLocalPlannerWrapper::callbackContact(const neuro_msgs::Contact::ConstPtr& contact)
+    {
+        boost::mutex::scoped_lock lock(state_mutex_);
+        is_stalled_ = contact->stall;
+        min_clearance_ = contact->min_clearance;
+        contact_stamp_ = contact->header.stamp;
+    }
+
+
+    // Forgets the last contact, e.g. at the end of an episode when the robot is about to be moved away from the
+    // obstacle. Called with the state mutex held.
+    void NeuroLocalPlannerWrapper::resetContact()
+    {
+        is_stalled_ = false;
+        min_clearance_ = std::numeric_limits<double>::infinity();
+        contact_stamp_ = ros::Time(0);
+    }
+
+
+    // Callback function for the subscriber to the ready signal of the planning node
+    void NeuroLocalPlannerWrapper::callbackAgentReady(std_msgs::Bool agent_ready)
+    {
+        agent_ready_ = agent_ready.data;
     }
 
 
-    // Callback function for the subscriber to the laser scan
-    void NeuroLocalPlannerWrapper::buildStateRepresentation(sensor_msgs::LaserScan laser_scan)
+    // Tells if anybody consumes the transitions, i.e. the embedded policy which needs them to drive or the planning
+    // node if it is subscribed and ready
+    bool NeuroLocalPlannerWrapper::isTransitionNeeded()
+    {
+        return policy_.isLoaded() ||
+               (transition_msg_pub_.getNumSubscribers() > 0 && (!wait_for_agent_ready_ || agent_ready_));
+    }
+
+
+    // Scans kept for the next control cycle in sync mode, about one second of scans of a fast laser
+    static const unsigned int MAX_PENDING_SCANS = 50;
+
+
+    // Callback function for the subscriber to the laser scan, in sync mode the scan is only stored for the next
+    // control cycle
+    void NeuroLocalPlannerWrapper::callbackLaserScan(const sensor_msgs::LaserScan::ConstPtr& laser_scan)
+    {
+        if (sync_to_control_)
+        {
+            // Without control cycles, e.g. while move_base has no goal, only the latest scans are kept
+            boost::mutex::scoped_lock lock(scan_mutex_);
+            pending_scans_.push_back(laser_scan);
+            if (pending_scans_.size() > MAX_PENDING_SCANS)
+            {
+                pending_scans_.pop_front();
+            }
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(state_mutex_);
+        buildStateRepresentation(*laser_scan, true);
+    }
+
+
+    // Checks for collision or goal and adds the laser scan to the state representation
+    void NeuroLocalPlannerWrapper::buildStateRepresentation(const sensor_msgs::LaserScan& laser_scan,
+                                                            bool is_frame_wanted)
     {
         // Check for collision or goal reached
         if (is_running_)
         {
             double reward = 0.0;
 
-            if (isCrashed(reward) || isAtGoal(reward))
+            if (isCrashed(laser_scan, reward) || isAtGoal(reward))
             {
                 // New episode so restart the time count
                 start_time_ = ros::Time::now().toSec();
@@ -342,6 +784,10 @@ namespace neuro_local_planner_wrapper
                 // This is the last transition published in this episode
                 is_running_ = false;
 
+                // Scans and contacts of this episode must not show up in the next one
+                accumulated_scan_points_.clear();
+                resetContact();
+
                 // Stop moving
                 setZeroAction();
 
@@ -350,20 +796,13 @@ namespace neuro_local_planner_wrapper
                 new_round.data = 1;
                 state_pub_.publish(new_round);
 
-                // Create transition message with empty state
-                transition_msg_.header.stamp = laser_scan.header.stamp;
-                transition_msg_.header.frame_id = customized_costmap_.header.frame_id;
-                transition_msg_.is_episode_finished = 1;
-                transition_msg_.reward = reward;
-
                 // clear buffer to get empty state representation
-                transition_msg_.state_representation.clear();
-
-                // Publish it
-                transition_msg_pub_.publish(transition_msg_);
+                frame_stack_.clear();
 
-                // increment seq for next costmap
-                transition_msg_.header.seq = transition_msg_.header.seq + 1;
+                // Publish transition message with empty state, this is a decision point even during action repeat
+                publishTransition(laser_scan.header.stamp, true, accumulated_reward_ + reward);
+                frames_since_decision_ = 0;
+                accumulated_reward_ = 0.0;
             }
             else if (ros::Time::now().toSec() - start_time_ > max_time_)
             {
@@ -373,97 +812,230 @@ namespace neuro_local_planner_wrapper
                 // This is the last transition published in this episode
                 is_running_ = false;
 
+                // Scans and contacts of this episode must not show up in the next one
+                accumulated_scan_points_.clear();
+                resetContact();
+
                 // Stop moving
                 setZeroAction();
 
+                // No transition ends this episode, so the noise is reset here for the next one
+                {
+                    boost::mutex::scoped_lock lock(action_mutex_);
+                    exploration_noise_.reset();
+                }
+
                 // Publish that a new round can be started with the stage_sim_bot
                 std_msgs::Bool new_round;
                 new_round.data = 1;
                 state_pub_.publish(new_round);
+
+                frames_since_decision_ = 0;
+                accumulated_reward_ = 0.0;
             }
             else
             {
-                // clear costmap/set all pixel gray
-                std::vector<int8_t> data(customized_costmap_.info.width*customized_costmap_.info.height,50);
-                customized_costmap_.data = data;
+                // Nobody consumes the states, so we skip the rasterization. The frame stack is dropped, since its
+                // frames would not be consecutive any more.
+                bool transition_needed = isTransitionNeeded();
+                bool visualization_needed = customized_costmap_pub_.getNumSubscribers() > 0;
+                if (!transition_needed)
+                {
+                    frame_stack_.clear();
+                    frames_since_decision_ = 0;
+                    accumulated_reward_ = 0.0;
+                }
+                if (!transition_needed && !visualization_needed)
+                {
+                    accumulated_scan_points_.clear();
+                    return;
+                }
+
+                // remember the scan points for the next frame, when copying the costmap the scans only clock the
+                // frames
+                if (!costmap_state_)
+                {
+                    accumulateLaserScanPoints(laser_scan);
+                }
+
+                // wait for more scans if the next frame is not wanted or not due yet
+                if (!is_frame_wanted || !isFrameDue(laser_scan.header.stamp))
+                {
+                    return;
+                }
+
+                // During action repeat only the last frames before the next decision are stacked, the ones before
+                // are not rasterized unless they are visualized
+                frames_since_decision_++;
+                accumulated_reward_ += reward;
+                bool is_stacked = transition_needed &&
+                                  frames_since_decision_ > (action_repeat_ - 1)*(int)transition_msg_.depth;
+                if (!is_stacked && !visualization_needed)
+                {
+                    accumulated_scan_points_.clear();
+                    return;
+                }
 
                 // to_delete: ------
                 customized_costmap_.header.stamp = laser_scan.header.stamp;
 
-                // add global plan as white pixel with some gradient to indicate its direction
-                addGlobalPlan();
+                if (costmap_state_)
+                {
+                    // take over the obstacles and inflation of the local costmap
+                    addCostmap();
 
-                // add laser scan points as invalid/black pixel
-                addLaserScanPoints(laser_scan);
+                    // add global plan as white pixel with some gradient to indicate its direction
+                    addGlobalPlan();
+                }
+                else
+                {
+                    // clear costmap/set all pixel gray
+                    customized_costmap_.data.assign(customized_costmap_.info.width*customized_costmap_.info.height, 50);
 
-                // publish customized costmap for visualization
-                customized_costmap_pub_.publish(customized_costmap_);
+                    // add global plan as white pixel with some gradient to indicate its direction
+                    addGlobalPlan();
 
-                // increment seq for next costmap
-                customized_costmap_.header.seq = customized_costmap_.header.seq + 1;
+                    // add laser scan points of all scans since the last frame as invalid/black pixel
+                    addLaserScanPoints();
+                }
 
                 // build transition message/add actual costmap to buffer
-                transition_msg_.state_representation.insert(transition_msg_.state_representation.end(),
-                                                            customized_costmap_.data.begin(),
-                                                            customized_costmap_.data.end());
-
-                // publish transition message after four consecutive costmaps are available
-                if (transition_msg_.state_representation.size() == transition_msg_.width*
-                                                                transition_msg_.height*
-                                                                transition_msg_.depth)
+                if (is_stacked)
                 {
-                    // publish
-                    transition_msg_.header.stamp = customized_costmap_.header.stamp;
-                    transition_msg_.header.frame_id = customized_costmap_.header.frame_id;
-                    transition_msg_.is_episode_finished = 0;
-                    transition_msg_.reward = reward;
-
-                    transition_msg_pub_.publish(transition_msg_);
+                    frame_stack_.insert(frame_stack_.end(), customized_costmap_.data.begin(),
+                                        customized_costmap_.data.end());
+                }
 
-                    // increment seq for next costmap
-                    transition_msg_.header.seq = transition_msg_.header.seq + 1;
+                // publish customized costmap for visualization, this hands its data over to the published message
+                if (visualization_needed)
+                {
+                    publishCustomizedCostmap();
+                }
 
-                    // clear buffer
-                    transition_msg_.state_representation.clear();
+                // publish transition message after four consecutive costmaps are available
+                if (frame_stack_.size() == transition_msg_.width*transition_msg_.height*transition_msg_.depth)
+                {
+                    publishTransition(customized_costmap_.header.stamp, false, accumulated_reward_);
+                    frames_since_decision_ = 0;
+                    accumulated_reward_ = 0.0;
                 }
             }
         }
     }
 
 
-    // Helper function to generate the transition msg
-    void NeuroLocalPlannerWrapper::addLaserScanPoints(const sensor_msgs::LaserScan& laser_scan)
+    // Publishes the customized costmap with a message from the pool. The data is swapped with the one of the pooled
+    // message, so it is not copied and the next frame gets a recycled buffer which is completely overwritten.
+    void NeuroLocalPlannerWrapper::publishCustomizedCostmap()
     {
-        // get source frame and target frame of laser scan points
-        std::string laser_scan_source_frame = laser_scan.header.frame_id;
-        std::string laser_scan_target_frame = customized_costmap_.header.frame_id;
+        boost::shared_ptr<nav_msgs::OccupancyGrid> costmap = costmap_pool_.acquire();
+        costmap->header = customized_costmap_.header;
+        costmap->info = customized_costmap_.info;
+        costmap->data.swap(customized_costmap_.data);
+        customized_costmap_.data.resize(customized_costmap_.info.width*customized_costmap_.info.height);
 
-        // stamp of first laser point in range
-        ros::Time laser_scan_stamp = laser_scan.header.stamp;
-        ros::Time customized_costmap_stamp = laser_scan_stamp;
+        customized_costmap_pub_.publish(boost::shared_ptr<const nav_msgs::OccupancyGrid>(costmap));
 
-        // update stamp of costmap
-        customized_costmap_.header.stamp = customized_costmap_stamp;
+        // increment seq for next costmap
+        customized_costmap_.header.seq = customized_costmap_.header.seq + 1;
+    }
 
-        // get transformation between robot base frame and frame of laser scan
-        tf::StampedTransform stamped_transform;
-        try
+
+    // Publishes the frame stack as transition with a message from the pool and clears it, at the end of an episode
+    // the stack is empty
+    void NeuroLocalPlannerWrapper::publishTransition(const ros::Time& stamp, bool is_episode_finished, double reward)
+    {
+        boost::shared_ptr<neuro_local_planner_wrapper::Transition> transition = transition_pool_.acquire();
+        transition->header = transition_msg_.header;
+        transition->header.stamp = stamp;
+        transition->header.frame_id = customized_costmap_.header.frame_id;
+        transition->width = transition_msg_.width;
+        transition->height = transition_msg_.height;
+        transition->depth = transition_msg_.depth;
+        transition->is_episode_finished = is_episode_finished ? 1 : 0;
+        transition->reward = reward;
+
+        // the frame stack gets the recycled buffer of the pooled message
+        transition->state_representation.swap(frame_stack_);
+        frame_stack_.clear();
+        transition->features.clear();
+        transition->latent.clear();
+
+        // the action the robot executed since the previous transition
         {
-            // ros::Time(0) gives us the latest available transform
-            tf_->lookupTransform(laser_scan_target_frame, laser_scan_source_frame, ros::Time(0), stamped_transform);
+            boost::mutex::scoped_lock lock(action_mutex_);
+            transition->executed_action = action_;
+            transition->action_stamp = action_applied_stamp_;
+            transition->action_deadline_missed = is_deadline_missed_since_transition_ ? 1 : 0;
+            transition->exploration_noise = action_noise_;
+            is_deadline_missed_since_transition_ = false;
+
+            // every episode starts with a fresh noise process
+            if (is_episode_finished)
+            {
+                exploration_noise_.reset();
+            }
+
+            // the deadline for the reply starts now, there is none at the end of an episode
+            transition_stamp_ = ros::Time::now();
+            is_action_pending_ = !is_episode_finished;
+            is_deadline_missed_ = false;
         }
-        catch (tf::TransformException ex)
+
+        if (!is_episode_finished)
         {
-            ROS_ERROR("%s",ex.what());
+            // add the scalar features of the latest frame
+            computeFeatures(transition->features);
+
+            // the embedded policy acts on the full state like the planning node would
+            if (policy_.isLoaded() && policy_.act(transition->state_representation, transition->width,
+                                                  transition->height, transition->depth, policy_action_) &&
+                policy_action_.size() >= 2)
+            {
+                geometry_msgs::Twist action;
+                action.linear.x = policy_action_[0];
+                action.linear.y = policy_action_[1];
+                callbackAction(action);
+            }
+
+            // send the latent code and, if the consumer only needs the latent code, only now and then the full state
+            // for debugging
+            if (state_encoder_.isLoaded() && transition_msg_pub_.getNumSubscribers() > 0 &&
+                state_encoder_.encode(transition->state_representation, transition->width, transition->height,
+                                      transition->depth, transition->latent) && latent_only_)
+            {
+                if (transitions_since_raw_frame_ > 0 && transitions_since_raw_frame_ < raw_frame_interval_)
+                {
+                    transition->state_representation.clear();
+                    transitions_since_raw_frame_++;
+                }
+                else
+                {
+                    transitions_since_raw_frame_ = 1;
+                }
+            }
         }
 
-        // x and y position of laser scan point in frame of laser scan
-        double x_position_laser_scan_frame;
-        double y_position_laser_scan_frame;
+        transition_msg_pub_.publish(boost::shared_ptr<const neuro_local_planner_wrapper::Transition>(transition));
+
+        // increment seq for next transition
+        transition_msg_.header.seq = transition_msg_.header.seq + 1;
+    }
 
-        // x and y position of laser scan point in robot base frame
-        double x_position_robot_base_frame;
-        double y_position_robot_base_frame;
+
+    // Transforms the laser scan points into the global frame of the local costmap and stores them for the next frame
+    void NeuroLocalPlannerWrapper::accumulateLaserScanPoints(const sensor_msgs::LaserScan& laser_scan)
+    {
+        // get transformation between robot base frame and frame of laser scan
+        tf::Transform stamped_transform;
+        if (!lookupLaserScanTransform(laser_scan.header.frame_id, stamped_transform))
+        {
+            return;
+        }
+
+        // laser scan frame -> robot base frame -> global frame of the local costmap, current_pose_ has just been
+        // updated by isCrashed()
+        tf::Transform laser_scan_to_fixed_frame = current_pose_ * stamped_transform;
 
         // iteration over all laser scan points
         for(unsigned int i = 0; i < laser_scan.ranges.size(); i++)
@@ -472,151 +1044,473 @@ namespace neuro_local_planner_wrapper
             {
                 // get x and y coordinates of laser scan point in frame of laser scan, z coordinate is ignored as we
                 // are working with a 2D costmap
-                x_position_laser_scan_frame = laser_scan.ranges.at(i) * cos(laser_scan.angle_min
-                                                                            + i * laser_scan.angle_increment);
-                y_position_laser_scan_frame = laser_scan.ranges.at(i) * sin(laser_scan.angle_min
-                                                                            + i * laser_scan.angle_increment);
-
-                // translation
-                x_position_robot_base_frame = x_position_laser_scan_frame + stamped_transform.getOrigin().getX();
-                y_position_robot_base_frame = y_position_laser_scan_frame + stamped_transform.getOrigin().getY();
-
-                // rotation
-                double roll, pitch, yaw;
-                stamped_transform.getBasis().getRPY(roll, pitch, yaw);
-                double x_temp = x_position_robot_base_frame;
-                double y_temp = y_position_robot_base_frame;
-                x_position_robot_base_frame = cos(yaw)*x_temp - sin(yaw)*y_temp;
-                y_position_robot_base_frame = sin(yaw)*x_temp + cos(yaw)*y_temp;
-
-                // transformation to costmap coordinates
-                int x, y;
-                x = (int)round(((x_position_robot_base_frame - customized_costmap_.info.origin.position.x)
-                                / costmap_->getSizeInMetersX())*customized_costmap_.info.width-0.5);
-                y = (int)round(((y_position_robot_base_frame - customized_costmap_.info.origin.position.y)
-                                / costmap_->getSizeInMetersY())*customized_costmap_.info.height-0.5);
-
-
-                if ((x >=0) && (y >=0) && (x < customized_costmap_.info.width) && (y < customized_costmap_.info.height))
-                {
-                    customized_costmap_.data[x + y*customized_costmap_.info.width] = 100;
-                }
+                double angle = laser_scan.angle_min + i * laser_scan.angle_increment;
+                tf::Point point_laser_scan_frame(laser_scan.ranges.at(i) * cos(angle),
+                                                 laser_scan.ranges.at(i) * sin(angle), 0.0);
+
+                accumulated_scan_points_.push_back(laser_scan_to_fixed_frame * point_laser_scan_frame);
             }
         }
     }
 
+
+    // Checks if enough time has passed since the last frame to build a new one
+    bool NeuroLocalPlannerWrapper::isFrameDue(const ros::Time& stamp)
+    {
+        // Without a state rate every laser scan gives a frame
+        if (state_rate_ <= 0.0)
+        {
+            return true;
+        }
+
+        // A stamp older than the last frame means the simulation time was reset
+        if (last_frame_stamp_.isZero() || stamp < last_frame_stamp_ ||
+            (stamp - last_frame_stamp_).toSec() >= 1.0/state_rate_)
+        {
+            last_frame_stamp_ = stamp;
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+
+    // Helper function to generate the transition msg
+    void NeuroLocalPlannerWrapper::addLaserScanPoints()
+    {
+        // The accumulated points are transformed back into the current robot base frame, this compensates the motion
+        // of the robot between the scans
+        rasterizer_.add_points(raster_geometry_, accumulated_scan_points_, current_pose_.inverse(),
+                               &customized_costmap_.data[0]);
+
+        accumulated_scan_points_.clear();
+    }
+
     void NeuroLocalPlannerWrapper::addGlobalPlan()
     {
-        // Transform the global plan into costmap coordinates
-        // pose given in fixed frame of global plan which is by default "map"
-        geometry_msgs::PoseStamped pose_fixed_frame;
+        // The goal of the features is only valid if it was transformed for this frame
+        is_goal_known_ = false;
 
-        // pose given in global frame of the local cost map
-        geometry_msgs::PoseStamped pose_robot_base_frame;
+        if (global_plan_.empty())
+        {
+            return;
+        }
 
-        std::vector<geometry_msgs::Point> global_plan_map_coordinates;
-        geometry_msgs::Point a_global_plan_map_coordinate;
+        // Transformation from the fixed frame of the global plan which is by default "map" to the robot base frame,
+        // looked up once for all poses of the plan
+        tf::Transform stamped_transform;
+        if (!lookupTransform(customized_costmap_.header.frame_id, global_plan_.back().header.frame_id,
+                             stamped_transform))
+        {
+            return;
+        }
 
-        std::vector<geometry_msgs::PoseStamped> global_plan_temp = global_plan_;
+        // The remaining path length is encoded as gray value from 0 at the goal up to PLAN_MAX_LEVEL, which stays
+        // clearly apart from the background of 50. It is measured in chamfer units (5 per straight step, 7 per
+        // diagonal step), so we get the gray value incrementally while walking the plan from the goal to the start.
+        int units_per_level = std::max(1, (int)round(plan_gradient_length_ * raster_geometry_.cells_per_meter *
+                                                     5.0 / PLAN_MAX_LEVEL));
+        int level = 0;
+        int progress = 0;
+
+        int previous_x = 0;
+        int previous_y = 0;
+        int goal_x = 0;
+        int goal_y = 0;
+
+        for(std::vector<geometry_msgs::PoseStamped>::reverse_iterator it = global_plan_.rbegin(); it !=
+                global_plan_.rend(); it++)
+        {
+            // Transform pose from fixed frame of global plan to robot base frame
+            tf::Point pose_robot_base_frame = stamped_transform * tf::Point(it->pose.position.x,
+                                                                            it->pose.position.y, 0.0);
 
-        for(std::vector<geometry_msgs::PoseStamped>::iterator it = global_plan_temp.begin(); it != global_plan_temp.end(); it++) {
+            // transformation to costmap coordinates
+            int x, y;
+            StateRasterizer<0, 0>::toCell(raster_geometry_, pose_robot_base_frame, x, y);
 
-            // Transform pose from fixed frame of global plan to global frame of local cost map
-            pose_fixed_frame = *it;
-            try
+            if (it == global_plan_.rbegin())
             {
-                pose_fixed_frame.header.stamp = customized_costmap_.header.stamp;
-                tf_->waitForTransform(customized_costmap_.header.frame_id, pose_fixed_frame.header.frame_id,
-                                      customized_costmap_.header.stamp, ros::Duration(0.2));
-                tf_->transformPose(customized_costmap_.header.frame_id, pose_fixed_frame, pose_robot_base_frame);
+                rasterizer_.add_plan_cell(raster_geometry_, x, y, level, &customized_costmap_.data[0]);
+                goal_x = x;
+                goal_y = y;
+                goal_robot_base_frame_ = pose_robot_base_frame;
+                is_goal_known_ = true;
             }
-            catch (tf::TransformException ex)
+            else
             {
-                ROS_ERROR("%s", ex.what());
+                rasterizer_.add_plan_segment(raster_geometry_, previous_x, previous_y, x, y, level, progress,
+                                             units_per_level, &customized_costmap_.data[0]);
             }
 
-            // transformation to costmap coordinates
-            int x, y;
-            x = (int)round(((pose_robot_base_frame.pose.position.x - customized_costmap_.info.origin.position.x)
-                            / costmap_->getSizeInMetersX()) * customized_costmap_.info.width - 0.5);
-            y = (int)round(((pose_robot_base_frame.pose.position.y - customized_costmap_.info.origin.position.y)
-                            / costmap_->getSizeInMetersY()) * customized_costmap_.info.height - 0.5);
+            previous_x = x;
+            previous_y = y;
+        }
+
+        // add global blob
+        addGoal(goal_x, goal_y);
+    }
+
+
+    // Recomputes the cell offsets of the goal blob if the resolution or the goal tolerance changed
+    void NeuroLocalPlannerWrapper::updateGoalStencil()
+    {
+        if (!goal_stencil_.empty() && goal_stencil_resolution_ == customized_costmap_.info.resolution &&
+            goal_stencil_tolerance_ == goal_tolerance_)
+        {
+            return;
+        }
+
+        goal_stencil_resolution_ = customized_costmap_.info.resolution;
+        goal_stencil_tolerance_ = goal_tolerance_;
 
-            if ((x >= 0) && (y >= 0) && (x < customized_costmap_.info.width) && (y < customized_costmap_.info.height))
+        int goal_tolerance_in_pixel = (int)round(goal_tolerance_ / goal_stencil_resolution_);
+
+        goal_stencil_.clear();
+        for (int x = -goal_tolerance_in_pixel; x <= goal_tolerance_in_pixel; x++)
+        {
+            for (int y = -goal_tolerance_in_pixel; y <= goal_tolerance_in_pixel; y++)
             {
-                a_global_plan_map_coordinate.x = x;
-                a_global_plan_map_coordinate.y = y;
+                if ((int)round(sqrt((double)(x*x + y*y))) <= goal_tolerance_in_pixel)
+                {
+                    goal_stencil_.push_back(std::make_pair(x, y));
+                }
+            }
+        }
+    }
+
+
+    // Adds the goal as white blob, if it is outside of the state representation a gray blob at the border shows the
+    // direction to it
+    void NeuroLocalPlannerWrapper::addGoal(int goal_x, int goal_y)
+    {
+        updateGoalStencil();
+
+        int width = (int)customized_costmap_.info.width;
+        int height = (int)customized_costmap_.info.height;
+
+        int8_t value = 0;
 
-                global_plan_map_coordinates.push_back(a_global_plan_map_coordinate);
+        // goal is outside of the current state representation, so we move the blob along the line from the robot to
+        // the goal onto the border
+        if ((goal_x < 0) || (goal_y < 0) || (goal_x >= width) || (goal_y >= height))
+        {
+            double center_x = (width - 1)/2.0;
+            double center_y = (height - 1)/2.0;
+            double direction_x = goal_x - center_x;
+            double direction_y = goal_y - center_y;
+
+            double scale = std::min(fabs(direction_x) > 0.0 ? center_x/fabs(direction_x) : 1.0,
+                                    fabs(direction_y) > 0.0 ? center_y/fabs(direction_y) : 1.0);
+
+            goal_x = (int)round(center_x + scale*direction_x);
+            goal_y = (int)round(center_y + scale*direction_y);
+
+            value = 25;
+        }
+
+        // the blob is clipped at the border of the state representation
+        for (std::vector<std::pair<int, int> >::const_iterator it = goal_stencil_.begin(); it != goal_stencil_.end();
+             it++)
+        {
+            int x = goal_x + it->first;
+            int y = goal_y + it->second;
+
+            if ((x >= 0) && (y >= 0) && (x < width) && (y < height))
+            {
+                customized_costmap_.data[x + y*width] = value;
             }
         }
+    }
+
+
+    // Fills the scalar features of the transition message, the layout is described in Transition.msg
+    void NeuroLocalPlannerWrapper::computeFeatures(std::vector<float>& features)
+    {
+        features.resize(9);
+
+        // odometry twist
+        tf::Stamped<tf::Pose> robot_vel;
+        odom_helper_.getRobotVel(robot_vel);
+        features[0] = (float)robot_vel.getOrigin().getX();
+        features[1] = (float)robot_vel.getOrigin().getY();
+        features[2] = (float)tf::getYaw(robot_vel.getRotation());
+
+        // goal in polar coordinates, it was transformed into the robot base frame together with the global plan, both
+        // are zero if there is no plan or its transformation failed
+        if (is_goal_known_)
+        {
+            features[3] = (float)sqrt(goal_robot_base_frame_.getX()*goal_robot_base_frame_.getX() +
+                                      goal_robot_base_frame_.getY()*goal_robot_base_frame_.getY());
+            features[4] = (float)atan2(goal_robot_base_frame_.getY(), goal_robot_base_frame_.getX());
+        }
+        else
+        {
+            features[3] = 0.0f;
+            features[4] = 0.0f;
+        }
 
-        // add global plan as white pixels
-        for(std::vector<geometry_msgs::Point>::iterator it = global_plan_map_coordinates.begin(); it !=
-                global_plan_map_coordinates.end(); it++)
+        // previous command, the actions are written by the subscriber thread
+        geometry_msgs::Twist action;
         {
-            a_global_plan_map_coordinate = *it;
-            customized_costmap_.data[a_global_plan_map_coordinate.x + a_global_plan_map_coordinate.y
-                                                                      * customized_costmap_.info.width] = 0;
+            boost::mutex::scoped_lock lock(action_mutex_);
+            action = action_;
         }
+        features[5] = (float)action.linear.x;
+        features[6] = (float)action.linear.y;
+        features[7] = (float)action.angular.z;
 
-        // add global plan as bright pixels with gradient
-        /*int total_plan_pixel_number = global_plan_map_coordinates.size();
-        int counter = 0;
-        for(std::vector<geometry_msgs::Point>::iterator it = global_plan_map_coordinates.begin(); it !=
-         global_plan_map_coordinates.end(); it++) {
-            a_global_plan_map_coordinate = *it;
-            customized_costmap_.data[a_global_plan_map_coordinate.x + a_global_plan_map_coordinate.y
-            * customized_costmap_.info.width] = 50 - round((double)counter/(double)(total_plan_pixel_number-1)*50.0);
-            counter++;
-        }*/
+        // time remaining until the episode is closed up
+        features[8] = (float)std::max(0.0, max_time_ - (ros::Time::now().toSec() - start_time_));
+    }
 
-        // add global blob
-        int goal_tolerance_in_pixel = (int)round(goalTolerance / (costmap_->getSizeInMetersX()
-                                                                  / costmap_->getSizeInCellsX()));
 
-        geometry_msgs::Point blob_position_map_coordinate;
+    // Helper function to initialize the table which translates costs of the local costmap into gray values
+    void NeuroLocalPlannerWrapper::initializeCostTranslationTable()
+    {
+        // free space and unknown cells are gray as in the laser scan mode, obstacles are black and the inflation fades
+        // from gray to black
+        for (int cost = 0; cost < 256; cost++)
+        {
+            if (cost == costmap_2d::NO_INFORMATION || cost == costmap_2d::FREE_SPACE)
+            {
+                cost_translation_table_[cost] = 50;
+            }
+            else if (cost >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE)
+            {
+                cost_translation_table_[cost] = 100;
+            }
+            else
+            {
+                cost_translation_table_[cost] = (int8_t)(50 + (cost*49)/(costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1));
+            }
+        }
+    }
 
-        bool got_valid_blob_position = false;
-        for(std::vector<geometry_msgs::Point>::reverse_iterator it = global_plan_map_coordinates.rbegin(); it !=
-                global_plan_map_coordinates.rend(); it++)
+
+    // Copies the local costmap into the state representation
+    void NeuroLocalPlannerWrapper::addCostmap()
+    {
+        unsigned int width = customized_costmap_.info.width;
+        unsigned int height = customized_costmap_.info.height;
+
+        customized_costmap_.data.resize(width*height);
+        int8_t* data = &customized_costmap_.data[0];
+
+        boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+        const unsigned char* char_map = costmap_->getCharMap();
+        unsigned int costmap_width = costmap_->getSizeInCellsX();
+        unsigned int costmap_height = costmap_->getSizeInCellsY();
+
+        // If the costmap is already given in the robot base frame we only have to translate the costs in a single pass
+        std::string costmap_frame = costmap_ros_->getGlobalFrameID();
+        std::string state_frame = customized_costmap_.header.frame_id;
+        if (tf::resolve("", costmap_frame) == tf::resolve("", state_frame) && costmap_width == width &&
+            costmap_height == height)
         {
-            blob_position_map_coordinate = *it;
-            if ((blob_position_map_coordinate.x - goal_tolerance_in_pixel >= 0) &&
-                (blob_position_map_coordinate.y - goal_tolerance_in_pixel >= 0) &&
-                (blob_position_map_coordinate.x + goal_tolerance_in_pixel < customized_costmap_.info.width) &&
-                (blob_position_map_coordinate.y + goal_tolerance_in_pixel < customized_costmap_.info.height))
+            for (unsigned int i = 0; i < width*height; i++)
             {
-                got_valid_blob_position = true;
-                break;
+                data[i] = cost_translation_table_[char_map[i]];
             }
+            return;
         }
 
-        // goal is is somewhere in the current state representation
-        if (got_valid_blob_position)
+        // Otherwise the rolling window is aligned with its global frame, so we look up for every cell of the state
+        // representation the costmap cell below its center. Source coordinates are stepped incrementally along the
+        // rows, so there is no trigonometry per cell.
+        double yaw = tf::getYaw(current_pose_.getRotation());
+        double cos_yaw = cos(yaw);
+        double sin_yaw = sin(yaw);
+        double resolution = costmap_->getResolution();
+        double scale = customized_costmap_.info.resolution / resolution;
+
+        // center of cell (0, 0) of the state representation in costmap coordinates
+        double x_0 = customized_costmap_.info.origin.position.x + 0.5*customized_costmap_.info.resolution;
+        double y_0 = customized_costmap_.info.origin.position.y + 0.5*customized_costmap_.info.resolution;
+        double row_x = (current_pose_.getOrigin().getX() + cos_yaw*x_0 - sin_yaw*y_0 - costmap_->getOriginX())
+                       / resolution;
+        double row_y = (current_pose_.getOrigin().getY() + sin_yaw*x_0 + cos_yaw*y_0 - costmap_->getOriginY())
+                       / resolution;
+
+        for (unsigned int y = 0; y < height; y++)
         {
-            int pixel_to_blob_center;
-            for (int x = (int)(blob_position_map_coordinate.x - goal_tolerance_in_pixel); x <=
-                    blob_position_map_coordinate.x + goal_tolerance_in_pixel; x++)
+            double map_x = row_x;
+            double map_y = row_y;
+
+            for (unsigned int x = 0; x < width; x++)
             {
-                for (int y = (int)(blob_position_map_coordinate.y - goal_tolerance_in_pixel); y <=
-                        blob_position_map_coordinate.y + goal_tolerance_in_pixel; y++)
+                int mx = (int)floor(map_x);
+                int my = (int)floor(map_y);
+
+                if (mx >= 0 && my >= 0 && mx < (int)costmap_width && my < (int)costmap_height)
+                {
+                    data[x + y*width] = cost_translation_table_[char_map[mx + my*costmap_width]];
+                }
+                else
                 {
-                    pixel_to_blob_center = (int)round(sqrt(pow((blob_position_map_coordinate.x - x), 2.0)
-                                                           + pow((blob_position_map_coordinate.y  - y), 2.0)));
+                    data[x + y*width] = 50;
+                }
+
+                map_x += cos_yaw*scale;
+                map_y += sin_yaw*scale;
+            }
+
+            row_x -= sin_yaw*scale;
+            row_y += cos_yaw*scale;
+        }
+    }
+
+
+    // Helper function to remove the leading slash of a tf frame id, tf2 does not accept it
+    static std::string stripLeadingSlash(const std::string& frame_id)
+    {
+        return (!frame_id.empty() && frame_id[0] == '/') ? frame_id.substr(1) : frame_id;
+    }
+
+
+    // Gets the latest transformation between two frames from the tf2 buffer, the frame ids may be given in the tf
+    // style with a leading slash
+    bool NeuroLocalPlannerWrapper::lookupTransform(const std::string& target_frame, const std::string& source_frame,
+                                                   tf::Transform& transform)
+    {
+        geometry_msgs::TransformStamped transform_msg;
+        try
+        {
+            // ros::Time(0) gives us the latest available transform
+            transform_msg = tf_buffer_.lookupTransform(stripLeadingSlash(target_frame), stripLeadingSlash(source_frame),
+                                                       ros::Time(0));
+        }
+        catch (tf2::TransformException& ex)
+        {
+            ROS_ERROR("%s", ex.what());
+            return false;
+        }
+
+        tf::transformMsgToTF(transform_msg.transform, transform);
+        return true;
+    }
+
 
-                    if (pixel_to_blob_center <= goal_tolerance_in_pixel)
+    // Gets the transformation from the frame of the laser scan to the robot base frame. The laser is mounted on the
+    // robot, so the transformation is static and only looked up once.
+    bool NeuroLocalPlannerWrapper::lookupLaserScanTransform(const std::string& laser_scan_frame,
+                                                            tf::Transform& transform)
+    {
+        std::map<std::string, tf::Transform>::const_iterator it = laser_scan_transforms_.find(laser_scan_frame);
+        if (it != laser_scan_transforms_.end())
+        {
+            transform = it->second;
+            return true;
+        }
+
+        if (!lookupTransform(customized_costmap_.header.frame_id, laser_scan_frame, transform))
+        {
+            return false;
+        }
+
+        laser_scan_transforms_[laser_scan_frame] = transform;
+        return true;
+    }
+
+
+    // Helper function to compute the distance of a point to a line segment
+    static double distanceToSegment(double x, double y, const geometry_msgs::Point& a, const geometry_msgs::Point& b)
+    {
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double length_squared = dx*dx + dy*dy;
+
+        double t = 0.0;
+        if (length_squared > 0.0)
+        {
+            t = std::max(0.0, std::min(1.0, ((x - a.x)*dx + (y - a.y)*dy)/length_squared));
+        }
+
+        return sqrt(pow(x - (a.x + t*dx), 2.0) + pow(y - (a.y + t*dy), 2.0));
+    }
+
+
+    // Precomputes a small robot centered grid which marks all cells covered by the footprint plus some padding, so a
+    // laser scan point only needs a lookup to be checked for collision
+    void NeuroLocalPlannerWrapper::initializeFootprintMask(double padding)
+    {
+        std::vector<geometry_msgs::Point> footprint = costmap_ros_->getRobotFootprint();
+        double resolution = customized_costmap_.info.resolution;
+
+        double radius = 0.0;
+        for (unsigned int i = 0; i < footprint.size(); i++)
+        {
+            radius = std::max(radius, sqrt(footprint[i].x*footprint[i].x + footprint[i].y*footprint[i].y));
+        }
+
+        footprint_mask_radius_ = (int)ceil((radius + padding)/resolution);
+        footprint_mask_size_ = 2*footprint_mask_radius_ + 1;
+        footprint_mask_.assign(footprint_mask_size_*footprint_mask_size_, false);
+
+        for (int my = 0; my < footprint_mask_size_; my++)
+        {
+            for (int mx = 0; mx < footprint_mask_size_; mx++)
+            {
+                double x = (mx - footprint_mask_radius_ + 0.5)*resolution;
+                double y = (my - footprint_mask_radius_ + 0.5)*resolution;
+
+                // inside of the footprint polygon (crossing number) or closer to its border than the padding
+                bool inside = false;
+                double distance = std::numeric_limits<double>::max();
+                for (unsigned int i = 0, j = footprint.size() - 1; i < footprint.size(); j = i++)
+                {
+                    if (((footprint[i].y > y) != (footprint[j].y > y)) &&
+                        (x < (footprint[j].x - footprint[i].x)*(y - footprint[i].y)/(footprint[j].y - footprint[i].y)
+                             + footprint[i].x))
                     {
-                        customized_costmap_.data[x + y*customized_costmap_.info.width] = 0;
+                        inside = !inside;
                     }
+                    distance = std::min(distance, distanceToSegment(x, y, footprint[i], footprint[j]));
                 }
+
+                footprint_mask_[mx + my*footprint_mask_size_] = inside || distance <= padding;
             }
         }
-        else // goal is outside of the current state representation
+    }
+
+
+    // Checks if any point of the laser scan lies within the footprint of the robot
+    bool NeuroLocalPlannerWrapper::isFootprintHit(const sensor_msgs::LaserScan& laser_scan)
+    {
+        tf::Transform stamped_transform;
+        if (!lookupLaserScanTransform(laser_scan.header.frame_id, stamped_transform))
+        {
+            return false;
+        }
+
+        double resolution = customized_costmap_.info.resolution;
+
+        for(unsigned int i = 0; i < laser_scan.ranges.size(); i++)
         {
+            // Points further away than the mask can never hit the footprint
+            if ((laser_scan.ranges[i] > laser_scan.range_min) && (laser_scan.ranges[i] < laser_scan.range_max) &&
+                (laser_scan.ranges[i] < (footprint_mask_radius_ + 1)*resolution +
+                                        stamped_transform.getOrigin().length()))
+            {
+                double angle = laser_scan.angle_min + i * laser_scan.angle_increment;
+                tf::Point point_robot_base_frame = stamped_transform * tf::Point(laser_scan.ranges[i] * cos(angle),
+                                                                                 laser_scan.ranges[i] * sin(angle),
+                                                                                 0.0);
+
+                int mx = (int)floor(point_robot_base_frame.getX()/resolution) + footprint_mask_radius_;
+                int my = (int)floor(point_robot_base_frame.getY()/resolution) + footprint_mask_radius_;
 
+                if (mx >= 0 && my >= 0 && mx < footprint_mask_size_ && my < footprint_mask_size_ &&
+                    footprint_mask_[mx + my*footprint_mask_size_])
+                {
+                    return true;
+                }
+            }
         }
 
+        return false;
     }
 
 };
@@ -0,0 +1,354 @@
+#include <neuro_local_planner_wrapper/quantized_policy.h>
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace neuro_local_planner_wrapper
+{
+    // Helper function to pad a row to the block size of the kernels
+    static unsigned int padToBlock(unsigned int size)
+    {
+        return (size + INT8_BLOCK_SIZE - 1)/INT8_BLOCK_SIZE*INT8_BLOCK_SIZE;
+    }
+
+
+    // Helper function to round and saturate a value to int8
+    static int8_t toInt8(float value)
+    {
+        return (int8_t)std::max(-127.0f, std::min(127.0f, (float)round(value)));
+    }
+
+
+    // Constructor
+    QuantizedPolicy::QuantizedPolicy() : multiply_int8_(selectMultiplyInt8()) {}
+
+
+    // Loads the actor layers, convolutions followed by fully connected layers. loadNetworkLayers already rejects empty
+    // layers and layers which don't take the outputs of the previous one of the same type, so only the change from
+    // the convolutions to the fully connected layers is left to check.
+    bool QuantizedPolicy::load(const std::string& file_name)
+    {
+        std::vector<NetworkLayer> layers;
+        layers_.clear();
+        if (!loadNetworkLayers(file_name, layers))
+        {
+            return false;
+        }
+
+        if (layers.empty() || layers[0].type != NetworkLayer::CONVOLUTION)
+        {
+            ROS_ERROR("The policy %s does not start with a convolution", file_name.c_str());
+            return false;
+        }
+
+        layers_.resize(layers.size());
+        for (unsigned int i = 0; i < layers.size(); i++)
+        {
+            if (i > 0 && layers[i - 1].type == NetworkLayer::FULLY_CONNECTED &&
+                layers[i].type == NetworkLayer::CONVOLUTION)
+            {
+                ROS_ERROR("Layer %u of the policy %s is a convolution after a fully connected layer", i,
+                          file_name.c_str());
+                layers_.clear();
+                return false;
+            }
+
+            // the first fully connected layer takes the flattened cells of the last convolution, their number
+            // depends on the state size and is checked for every state
+            if (i > 0 && layers[i - 1].type == NetworkLayer::CONVOLUTION &&
+                layers[i].type == NetworkLayer::FULLY_CONNECTED &&
+                layers[i].input_size % layers[i - 1].output_size != 0)
+            {
+                ROS_ERROR("Layer %u of the policy %s takes %u inputs, which are no cells of %u channels", i,
+                          file_name.c_str(), layers[i].input_size, layers[i - 1].output_size);
+                layers_.clear();
+                return false;
+            }
+
+            quantize(layers[i], layers_[i]);
+        }
+
+        ROS_INFO("Loaded int8 policy with %lu layers from %s", layers_.size(), file_name.c_str());
+        return true;
+    }
+
+
+    // Tell if a policy was loaded
+    bool QuantizedPolicy::isLoaded() const
+    {
+        return !layers_.empty();
+    }
+
+
+    // Quantizes the weights of each output symmetrically, so that its largest weight becomes 127
+    void QuantizedPolicy::quantize(const NetworkLayer& layer, QuantizedLayer& quantized)
+    {
+        quantized.type = layer.type;
+        quantized.activation = layer.activation;
+        quantized.kernel_size = layer.kernel_size;
+        quantized.stride = layer.stride;
+        quantized.input_size = layer.input_size;
+        quantized.output_size = layer.output_size;
+        quantized.biases = layer.biases;
+
+        // TensorFlow stores the weights of all outputs next to each other, the order of the inputs
+        // ([kernel_size][kernel_size][input_size] for convolutions) is kept within each row
+        unsigned int size = layer.weights.size()/layer.output_size;
+        quantized.row_size = padToBlock(size);
+        quantized.weights.assign(layer.output_size*quantized.row_size, 0);
+        quantized.weight_scales.resize(layer.output_size);
+
+        for (unsigned int o = 0; o < layer.output_size; o++)
+        {
+            float max_weight = 0.0f;
+            for (unsigned int i = 0; i < size; i++)
+            {
+                max_weight = std::max(max_weight, (float)fabs(layer.weights[i*layer.output_size + o]));
+            }
+
+            float scale = max_weight > 0.0f ? max_weight/127.0f : 1.0f;
+            quantized.weight_scales[o] = scale;
+
+            int8_t* row = &quantized.weights[o*quantized.row_size];
+            for (unsigned int i = 0; i < size; i++)
+            {
+                row[i] = toInt8(layer.weights[i*layer.output_size + o]/scale);
+            }
+        }
+    }
+
+
+    // Computes the action for a state as a batch of one
+    bool QuantizedPolicy::act(const std::vector<int8_t>& state, unsigned int width, unsigned int height,
+                              unsigned int depth, std::vector<float>& action)
+    {
+        std::vector<const std::vector<int8_t>*> states(1, &state);
+        std::vector<std::vector<float> > actions;
+        if (!actBatch(states, width, height, depth, actions))
+        {
+            return false;
+        }
+
+        action.swap(actions[0]);
+        return true;
+    }
+
+
+    // Computes the actions for a batch of states
+    bool QuantizedPolicy::actBatch(const std::vector<const std::vector<int8_t>*>& states, unsigned int width,
+                                   unsigned int height, unsigned int depth, std::vector<std::vector<float> >& actions)
+    {
+        if (layers_.empty() || layers_[0].input_size != depth)
+        {
+            ROS_ERROR("State of %ux%ux%u cells does not fit the policy", width, height, depth);
+            return false;
+        }
+
+        // Nothing to compute, and the buffers of the batch would stay empty
+        if (states.empty())
+        {
+            actions.clear();
+            return true;
+        }
+
+        for (unsigned int b = 0; b < states.size(); b++)
+        {
+            if (states[b]->size() != width*height*depth)
+            {
+                ROS_ERROR("State of %lu values does not have %ux%ux%u cells", states[b]->size(), width, height, depth);
+                return false;
+            }
+        }
+
+        // The convolutions come first, the fully connected layers start at first_fully
+        unsigned int first_fully = 0;
+        while (first_fully < layers_.size() && layers_[first_fully].type == NetworkLayer::CONVOLUTION)
+        {
+            first_fully++;
+        }
+
+        unsigned int count = states.size();
+        actions.resize(count);
+        if (first_fully < layers_.size())
+        {
+            batch_input_.assign(count*layers_[first_fully].row_size, 0);
+            batch_scales_.resize(count);
+        }
+
+        for (unsigned int b = 0; b < count; b++)
+        {
+            // The planning node feeds the state as image[x][y][frame] scaled by 1/100, here we only reorder the int8
+            // cells and take 1/100 as their scale
+            const std::vector<int8_t>& state = *states[b];
+            input_.resize(state.size());
+            for (unsigned int d = 0; d < depth; d++)
+            {
+                for (unsigned int y = 0; y < height; y++)
+                {
+                    const int8_t* row = &state[d*width*height + y*width];
+                    for (unsigned int x = 0; x < width; x++)
+                    {
+                        input_[(x*height + y)*depth + d] = row[x];
+                    }
+                }
+            }
+            float input_scale = 0.01f;
+
+            unsigned int rows = width;
+            unsigned int cols = height;
+            for (unsigned int i = 0; i < first_fully; i++)
+            {
+                const QuantizedLayer& layer = layers_[i];
+                if (rows < layer.kernel_size || cols < layer.kernel_size)
+                {
+                    ROS_ERROR("State of %ux%u cells is too small for the policy", width, height);
+                    return false;
+                }
+
+                convolve(layer, input_scale, rows, cols, output_);
+                rows = (rows - layer.kernel_size)/layer.stride + 1;
+                cols = (cols - layer.kernel_size)/layer.stride + 1;
+
+                if (i + 1 < first_fully)
+                {
+                    input_.resize(output_.size());
+                    input_scale = quantizeActivations(&output_[0], output_.size(), output_.size(), &input_[0]);
+                }
+            }
+
+            if (first_fully == layers_.size())
+            {
+                actions[b].assign(output_.begin(), output_.end());
+                continue;
+            }
+
+            // a fully connected layer takes the flattened output, which has to be padded for the kernels
+            const QuantizedLayer& next = layers_[first_fully];
+            if (output_.size() != next.input_size)
+            {
+                ROS_ERROR("Output of %lu values of layer %u does not fit the policy", output_.size(),
+                          first_fully - 1);
+                return false;
+            }
+
+            batch_scales_[b] = quantizeActivations(&output_[0], output_.size(), next.row_size,
+                                                   &batch_input_[b*next.row_size]);
+        }
+
+        for (unsigned int i = first_fully; i < layers_.size(); i++)
+        {
+            const QuantizedLayer& layer = layers_[i];
+            multiply(layer, count, output_);
+
+            if (i + 1 < layers_.size())
+            {
+                const QuantizedLayer& next = layers_[i + 1];
+                batch_input_.assign(count*next.row_size, 0);
+                for (unsigned int b = 0; b < count; b++)
+                {
+                    batch_scales_[b] = quantizeActivations(&output_[b*layer.output_size], layer.output_size,
+                                                           next.row_size, &batch_input_[b*next.row_size]);
+                }
+            }
+            else
+            {
+                for (unsigned int b = 0; b < count; b++)
+                {
+                    actions[b].assign(output_.begin() + b*layer.output_size,
+                                      output_.begin() + (b + 1)*layer.output_size);
+                }
+            }
+        }
+
+        return true;
+    }
+
+
+    // Applies a 'VALID' convolution, the kernel rows of a patch are contiguous in the input so it is gathered with
+    // one copy per kernel row
+    void QuantizedPolicy::convolve(const QuantizedLayer& layer, float input_scale, unsigned int rows,
+                                   unsigned int cols, std::vector<float>& output)
+    {
+        unsigned int output_rows = (rows - layer.kernel_size)/layer.stride + 1;
+        unsigned int output_cols = (cols - layer.kernel_size)/layer.stride + 1;
+        unsigned int channels = layer.output_size;
+        unsigned int patch_row_size = layer.kernel_size*layer.input_size;
+
+        output.resize(output_rows*output_cols*channels);
+        patch_.assign(layer.row_size, 0);
+        sums_.resize(channels);
+
+        for (unsigned int r = 0; r < output_rows; r++)
+        {
+            for (unsigned int c = 0; c < output_cols; c++)
+            {
+                for (unsigned int kr = 0; kr < layer.kernel_size; kr++)
+                {
+                    memcpy(&patch_[kr*patch_row_size],
+                           &input_[((r*layer.stride + kr)*cols + c*layer.stride)*layer.input_size], patch_row_size);
+                }
+
+                multiply_int8_(&layer.weights[0], &patch_[0], channels, layer.row_size, 1, &sums_[0]);
+
+                float* out = &output[(r*output_cols + c)*channels];
+                for (unsigned int o = 0; o < channels; o++)
+                {
+                    out[o] = sums_[o]*input_scale*layer.weight_scales[o] + layer.biases[o];
+                    if (layer.activation == NetworkLayer::RELU)
+                    {
+                        out[o] = std::max(out[o], 0.0f);
+                    }
+                }
+            }
+        }
+    }
+
+
+    // Applies a fully connected layer on the padded inputs of the batch
+    void QuantizedPolicy::multiply(const QuantizedLayer& layer, unsigned int count, std::vector<float>& output)
+    {
+        output.resize(count*layer.output_size);
+        sums_.resize(count*layer.output_size);
+
+        multiply_int8_(&layer.weights[0], &batch_input_[0], layer.output_size, layer.row_size, count, &sums_[0]);
+
+        for (unsigned int b = 0; b < count; b++)
+        {
+            float* out = &output[b*layer.output_size];
+            const int32_t* sums = &sums_[b*layer.output_size];
+            for (unsigned int o = 0; o < layer.output_size; o++)
+            {
+                out[o] = sums[o]*batch_scales_[b]*layer.weight_scales[o] + layer.biases[o];
+                if (layer.activation == NetworkLayer::RELU)
+                {
+                    out[o] = std::max(out[o], 0.0f);
+                }
+            }
+        }
+    }
+
+
+    // Quantizes the activations symmetrically with the largest one becoming 127
+    float QuantizedPolicy::quantizeActivations(const float* values, unsigned int size, unsigned int padded_size,
+                                               int8_t* quantized)
+    {
+        float max_value = 0.0f;
+        for (unsigned int i = 0; i < size; i++)
+        {
+            max_value = std::max(max_value, (float)fabs(values[i]));
+        }
+
+        float scale = max_value > 0.0f ? max_value/127.0f : 1.0f;
+
+        for (unsigned int i = 0; i < size; i++)
+        {
+            quantized[i] = toInt8(values[i]/scale);
+        }
+        std::fill(quantized + size, quantized + padded_size, 0);
+
+        return scale;
+    }
+};
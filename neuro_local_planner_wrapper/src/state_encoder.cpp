@@ -0,0 +1,143 @@
+#include <neuro_local_planner_wrapper/state_encoder.h>
+
+#include <ros/ros.h>
+
+#include <algorithm>
+
+namespace neuro_local_planner_wrapper
+{
+    // Constructor
+    StateEncoder::StateEncoder() {}
+
+
+    // Loads the encoder layers, only convolutions are supported
+    bool StateEncoder::load(const std::string& file_name)
+    {
+        if (!loadNetworkLayers(file_name, layers_))
+        {
+            return false;
+        }
+
+        if (layers_.empty())
+        {
+            ROS_ERROR("The encoder %s has no layers", file_name.c_str());
+            return false;
+        }
+
+        for (unsigned int i = 0; i < layers_.size(); i++)
+        {
+            if (layers_[i].type != NetworkLayer::CONVOLUTION)
+            {
+                ROS_ERROR("Layer %u of the encoder %s is no convolution", i, file_name.c_str());
+                layers_.clear();
+                return false;
+            }
+        }
+
+        ROS_INFO("Loaded encoder with %lu layers from %s", layers_.size(), file_name.c_str());
+        return true;
+    }
+
+
+    // Tell if an encoder was loaded
+    bool StateEncoder::isLoaded() const
+    {
+        return !layers_.empty();
+    }
+
+
+    // Encodes a state into the latent code
+    bool StateEncoder::encode(const std::vector<int8_t>& state, unsigned int width, unsigned int height,
+                              unsigned int depth, std::vector<float>& latent)
+    {
+        if (layers_.empty() || layers_[0].input_size != depth || state.size() != width*height*depth)
+        {
+            ROS_ERROR("State of %ux%ux%u cells does not fit the encoder", width, height, depth);
+            return false;
+        }
+
+        // The planning node feeds the state as image[x][y][frame] scaled by 1/100, while the transition message
+        // holds the frames one after another in row major order
+        input_.resize(state.size());
+        for (unsigned int d = 0; d < depth; d++)
+        {
+            for (unsigned int y = 0; y < height; y++)
+            {
+                const int8_t* row = &state[d*width*height + y*width];
+                for (unsigned int x = 0; x < width; x++)
+                {
+                    input_[(x*height + y)*depth + d] = row[x]/100.0f;
+                }
+            }
+        }
+
+        unsigned int rows = width;
+        unsigned int cols = height;
+        for (unsigned int i = 0; i < layers_.size(); i++)
+        {
+            const NetworkLayer& layer = layers_[i];
+            if (rows < layer.kernel_size || cols < layer.kernel_size)
+            {
+                ROS_ERROR("State of %ux%u cells is too small for the encoder", width, height);
+                return false;
+            }
+
+            convolve(layer, input_, rows, cols, output_);
+            rows = (rows - layer.kernel_size)/layer.stride + 1;
+            cols = (cols - layer.kernel_size)/layer.stride + 1;
+            input_.swap(output_);
+        }
+
+        latent.assign(input_.begin(), input_.end());
+        return true;
+    }
+
+
+    // Applies a 'VALID' convolution and its activation, the output channels are the innermost loop so it runs over
+    // contiguous weights
+    void StateEncoder::convolve(const NetworkLayer& layer, const std::vector<float>& input, unsigned int rows,
+                                unsigned int cols, std::vector<float>& output)
+    {
+        unsigned int output_rows = (rows - layer.kernel_size)/layer.stride + 1;
+        unsigned int output_cols = (cols - layer.kernel_size)/layer.stride + 1;
+        unsigned int channels = layer.output_size;
+
+        output.resize(output_rows*output_cols*channels);
+
+        for (unsigned int r = 0; r < output_rows; r++)
+        {
+            for (unsigned int c = 0; c < output_cols; c++)
+            {
+                float* out = &output[(r*output_cols + c)*channels];
+                std::copy(layer.biases.begin(), layer.biases.end(), out);
+
+                for (unsigned int kr = 0; kr < layer.kernel_size; kr++)
+                {
+                    for (unsigned int kc = 0; kc < layer.kernel_size; kc++)
+                    {
+                        const float* in = &input[((r*layer.stride + kr)*cols + c*layer.stride + kc)*layer.input_size];
+                        const float* weights = &layer.weights[(kr*layer.kernel_size + kc)*layer.input_size*channels];
+
+                        for (unsigned int i = 0; i < layer.input_size; i++)
+                        {
+                            const float value = in[i];
+                            const float* w = weights + i*channels;
+                            for (unsigned int o = 0; o < channels; o++)
+                            {
+                                out[o] += value*w[o];
+                            }
+                        }
+                    }
+                }
+
+                if (layer.activation == NetworkLayer::RELU)
+                {
+                    for (unsigned int o = 0; o < channels; o++)
+                    {
+                        out[o] = std::max(out[o], 0.0f);
+                    }
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#ifndef NEURO_LOCAL_PLANNER_WRAPPER_TEST_NETWORK_FILE_H_
+#define NEURO_LOCAL_PLANNER_WRAPPER_TEST_NETWORK_FILE_H_
+
+#include <neuro_local_planner_wrapper/network_layers.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Helper class to write a network file as export_network.py does, the weights and biases of layers added without
+// values are counted up from 0 across the file. The file is removed again with the helper.
+class NetworkFile
+{
+    public:
+
+        NetworkFile() : name_("/tmp/test_network_file.bin") {}
+
+        ~NetworkFile()
+        {
+            remove(name_.c_str());
+        }
+
+        void addLayer(uint32_t type, uint32_t activation, uint32_t kernel_size, uint32_t stride, uint32_t input_size,
+                      uint32_t output_size)
+        {
+            addLayer(type, activation, kernel_size, stride, input_size, output_size, std::vector<float>());
+        }
+
+        // Values are the weights in TensorFlow layout followed by the biases
+        void addLayer(uint32_t type, uint32_t activation, uint32_t kernel_size, uint32_t stride, uint32_t input_size,
+                      uint32_t output_size, const std::vector<float>& values)
+        {
+            uint32_t description[6] = {type, activation, kernel_size, stride, input_size, output_size};
+            descriptions_.insert(descriptions_.end(), description, description + 6);
+            values_.push_back(values);
+        }
+
+        // Writes the file with the given number of values missing at its end
+        const std::string& write(unsigned int missing_values = 0)
+        {
+            std::ofstream file(name_.c_str(), std::ios::out | std::ios::binary);
+            uint32_t header[2] = {1, (uint32_t)values_.size()};
+            file.write("NEURONET", 8);
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+            float value = 0.0f;
+            for (unsigned int i = 0; i < values_.size(); i++)
+            {
+                const uint32_t* description = &descriptions_[6*i];
+                file.write(reinterpret_cast<const char*>(description), 6*sizeof(uint32_t));
+
+                std::vector<float> values = values_[i];
+                if (values.empty())
+                {
+                    size_t count = (size_t)description[4]*description[5];
+                    if (description[0] == neuro_local_planner_wrapper::NetworkLayer::CONVOLUTION)
+                    {
+                        count *= description[2]*description[2];
+                    }
+                    count += description[5];
+
+                    for (size_t j = 0; j < count; j++, value++)
+                    {
+                        values.push_back(value);
+                    }
+                }
+
+                if (i + 1 == values_.size())
+                {
+                    values.resize(values.size() - missing_values);
+                }
+
+                if (!values.empty())
+                {
+                    file.write(reinterpret_cast<const char*>(&values[0]), values.size()*sizeof(float));
+                }
+            }
+
+            return name_;
+        }
+
+    private:
+
+        std::string name_;
+        std::vector<uint32_t> descriptions_;
+        std::vector<std::vector<float> > values_;
+};
+#endif
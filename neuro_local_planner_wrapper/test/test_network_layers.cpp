@@ -0,0 +1,139 @@
+#include <neuro_local_planner_wrapper/network_layers.h>
+#include <neuro_local_planner_wrapper/state_encoder.h>
+
+#include "network_file.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using neuro_local_planner_wrapper::NetworkLayer;
+using neuro_local_planner_wrapper::StateEncoder;
+using neuro_local_planner_wrapper::loadNetworkLayers;
+
+
+// A well formed file gives all layers with their weights and biases in file order
+TEST(NetworkLayers, loadsLayers)
+{
+    NetworkFile file;
+    file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+    file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 2, 1, 8, 2);
+    file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 18, 2);
+
+    std::vector<NetworkLayer> layers;
+    ASSERT_TRUE(loadNetworkLayers(file.write(), layers));
+    ASSERT_EQ(3u, layers.size());
+
+    EXPECT_EQ(NetworkLayer::CONVOLUTION, layers[0].type);
+    EXPECT_EQ(NetworkLayer::RELU, layers[0].activation);
+    EXPECT_EQ(3u, layers[0].kernel_size);
+    EXPECT_EQ(2u, layers[0].stride);
+    EXPECT_EQ(3u*3*4*8, layers[0].weights.size());
+    EXPECT_EQ(8u, layers[0].biases.size());
+    EXPECT_EQ(0.0f, layers[0].weights[0]);
+    EXPECT_EQ(3.0f*3*4*8, layers[0].biases[0]);
+
+    EXPECT_EQ(NetworkLayer::FULLY_CONNECTED, layers[2].type);
+    EXPECT_EQ(NetworkLayer::LINEAR, layers[2].activation);
+    EXPECT_EQ(18u*2, layers[2].weights.size());
+    EXPECT_EQ(2u, layers[2].biases.size());
+}
+
+
+// Broken files are rejected as a whole
+TEST(NetworkLayers, rejectsBrokenFiles)
+{
+    std::vector<NetworkLayer> layers;
+    EXPECT_FALSE(loadNetworkLayers("/tmp/test_network_layers_missing.bin", layers));
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        EXPECT_FALSE(loadNetworkLayers(file.write(1), layers));
+        EXPECT_TRUE(layers.empty());
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(2, NetworkLayer::RELU, 3, 2, 4, 8);
+        EXPECT_FALSE(loadNetworkLayers(file.write(), layers));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, 2, 3, 2, 4, 8);
+        EXPECT_FALSE(loadNetworkLayers(file.write(), layers));
+    }
+}
+
+
+// Empty kernels, strides, inputs or outputs would divide by zero or give empty layers
+TEST(NetworkLayers, rejectsEmptyLayers)
+{
+    std::vector<NetworkLayer> layers;
+    const uint32_t sizes[4][4] = {{0, 2, 4, 8}, {3, 0, 4, 8}, {3, 2, 0, 8}, {3, 2, 4, 0}};
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, sizes[i][0], sizes[i][1], sizes[i][2],
+                      sizes[i][3]);
+        EXPECT_FALSE(loadNetworkLayers(file.write(), layers)) << "sizes " << i;
+        EXPECT_TRUE(layers.empty());
+    }
+
+    // fully connected layers have neither kernel nor stride
+    NetworkFile file;
+    file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 4, 0);
+    EXPECT_FALSE(loadNetworkLayers(file.write(), layers));
+}
+
+
+// The inputs of a layer have to be the outputs of the previous one of the same type
+TEST(NetworkLayers, rejectsMismatchedLayers)
+{
+    std::vector<NetworkLayer> layers;
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 2, 1, 16, 2);
+        EXPECT_FALSE(loadNetworkLayers(file.write(), layers));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 8, 4);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 5, 2);
+        EXPECT_FALSE(loadNetworkLayers(file.write(), layers));
+    }
+}
+
+
+// The encoder only takes convolutions and checks the state against its first layer
+TEST(StateEncoder, load)
+{
+    StateEncoder encoder;
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 8, 2);
+        EXPECT_FALSE(encoder.load(file.write()));
+        EXPECT_FALSE(encoder.isLoaded());
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::LINEAR, 2, 1, 8, 2);
+        ASSERT_TRUE(encoder.load(file.write()));
+        EXPECT_TRUE(encoder.isLoaded());
+    }
+
+    // 7x7 cells give 3x3 after the first and 2x2 after the second layer
+    std::vector<int8_t> state(7*7*4, 100);
+    std::vector<float> latent;
+    EXPECT_TRUE(encoder.encode(state, 7, 7, 4, latent));
+    EXPECT_EQ(2u*2*2, latent.size());
+
+    EXPECT_FALSE(encoder.encode(state, 7, 7, 3, latent));
+    EXPECT_FALSE(encoder.encode(std::vector<int8_t>(3*3*4, 100), 3, 3, 4, latent));
+}
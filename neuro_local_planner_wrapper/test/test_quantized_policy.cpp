@@ -0,0 +1,255 @@
+#include <neuro_local_planner_wrapper/quantized_policy.h>
+
+#include "network_file.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using neuro_local_planner_wrapper::NetworkLayer;
+using neuro_local_planner_wrapper::QuantizedPolicy;
+
+
+// Helper function to get reproducible values in [-1, 1]
+static float nextValue(unsigned int& seed)
+{
+    seed = seed*1103515245u + 12345u;
+    return ((seed >> 8) & 0xffff)/32767.5f - 1.0f;
+}
+
+
+// Layer of the float reference, the values are the weights in TensorFlow layout followed by the biases
+struct ReferenceLayer
+{
+    NetworkLayer::Type type;
+    NetworkLayer::Activation activation;
+    unsigned int kernel_size, stride, input_size, output_size;
+    std::vector<float> values;
+};
+
+
+// Helper function to add a layer with reproducible values to the reference and the network file
+static void addLayer(NetworkLayer::Type type, NetworkLayer::Activation activation, unsigned int kernel_size,
+                     unsigned int stride, unsigned int input_size, unsigned int output_size, unsigned int& seed,
+                     std::vector<ReferenceLayer>& reference, NetworkFile& file)
+{
+    ReferenceLayer layer;
+    layer.type = type;
+    layer.activation = activation;
+    layer.kernel_size = kernel_size;
+    layer.stride = stride;
+    layer.input_size = input_size;
+    layer.output_size = output_size;
+
+    unsigned int count = input_size*output_size;
+    if (type == NetworkLayer::CONVOLUTION)
+    {
+        count *= kernel_size*kernel_size;
+    }
+    for (unsigned int i = 0; i < count + output_size; i++)
+    {
+        // scaled like a Xavier initialization, the biases a bit smaller
+        layer.values.push_back(nextValue(seed)*(i < count ? 1.7f/sqrtf(count/output_size) : 0.1f));
+    }
+
+    reference.push_back(layer);
+    file.addLayer(type, activation, kernel_size, stride, input_size, output_size, layer.values);
+}
+
+
+// Computes the action of the float reference for a state as it is in the transition message
+static std::vector<float> act(const std::vector<ReferenceLayer>& layers, const std::vector<int8_t>& state,
+                              unsigned int width, unsigned int height, unsigned int depth)
+{
+    std::vector<float> input(state.size());
+    for (unsigned int d = 0; d < depth; d++)
+    {
+        for (unsigned int y = 0; y < height; y++)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                input[(x*height + y)*depth + d] = state[d*width*height + y*width + x]/100.0f;
+            }
+        }
+    }
+
+    unsigned int rows = width, cols = height;
+    for (unsigned int l = 0; l < layers.size(); l++)
+    {
+        const ReferenceLayer& layer = layers[l];
+        unsigned int k = layer.kernel_size, s = layer.stride;
+        unsigned int in = layer.input_size, out = layer.output_size;
+        const float* biases = &layer.values[layer.values.size() - out];
+
+        std::vector<float> output;
+        if (layer.type == NetworkLayer::CONVOLUTION)
+        {
+            unsigned int output_rows = (rows - k)/s + 1, output_cols = (cols - k)/s + 1;
+            output.resize(output_rows*output_cols*out);
+            for (unsigned int r = 0; r < output_rows; r++)
+            {
+                for (unsigned int c = 0; c < output_cols; c++)
+                {
+                    float* cell = &output[(r*output_cols + c)*out];
+                    std::copy(biases, biases + out, cell);
+                    for (unsigned int kr = 0; kr < k; kr++)
+                    {
+                        for (unsigned int kc = 0; kc < k; kc++)
+                        {
+                            for (unsigned int i = 0; i < in; i++)
+                            {
+                                float value = input[((r*s + kr)*cols + c*s + kc)*in + i];
+                                for (unsigned int o = 0; o < out; o++)
+                                {
+                                    cell[o] += value*layer.values[((kr*k + kc)*in + i)*out + o];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            rows = output_rows;
+            cols = output_cols;
+        }
+        else
+        {
+            EXPECT_EQ(in, input.size());
+            output.assign(biases, biases + out);
+            for (unsigned int i = 0; i < in; i++)
+            {
+                for (unsigned int o = 0; o < out; o++)
+                {
+                    output[o] += input[i]*layer.values[i*out + o];
+                }
+            }
+        }
+
+        if (layer.activation == NetworkLayer::RELU)
+        {
+            for (unsigned int i = 0; i < output.size(); i++)
+            {
+                output[i] = std::max(output[i], 0.0f);
+            }
+        }
+        input.swap(output);
+    }
+
+    return input;
+}
+
+
+// The int8 path stays close to the float network it was quantized from
+TEST(QuantizedPolicy, matchesFloatReference)
+{
+    unsigned int seed = 42;
+    std::vector<ReferenceLayer> reference;
+    NetworkFile file;
+    addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 4, 2, 4, 16, seed, reference, file);
+    addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 1, 16, 24, seed, reference, file);
+    addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 4*4*24, 64, seed, reference, file);
+    addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 64, 2, seed, reference, file);
+
+    QuantizedPolicy policy;
+    ASSERT_TRUE(policy.load(file.write()));
+
+    // 14x14 cells give 6x6 after the first and 4x4 after the second layer
+    const unsigned int width = 14, height = 14, depth = 4;
+    std::vector<std::vector<int8_t> > states(8, std::vector<int8_t>(width*height*depth));
+    std::vector<const std::vector<int8_t>*> batch;
+    for (unsigned int b = 0; b < states.size(); b++)
+    {
+        // gray background with some obstacles and plan cells, like the state of the wrapper
+        for (unsigned int i = 0; i < states[b].size(); i++)
+        {
+            float value = nextValue(seed);
+            states[b][i] = value > 0.8f ? 100 : (value < -0.8f ? (int8_t)(30*(value + 1.0f)/0.2f) : 50);
+        }
+        batch.push_back(&states[b]);
+    }
+
+    std::vector<std::vector<float> > actions;
+    ASSERT_TRUE(policy.actBatch(batch, width, height, depth, actions));
+    ASSERT_EQ(states.size(), actions.size());
+
+    for (unsigned int b = 0; b < states.size(); b++)
+    {
+        std::vector<float> expected = act(reference, states[b], width, height, depth);
+        ASSERT_EQ(expected.size(), actions[b].size());
+
+        // the error of each layer is a fraction of a quantization step of its largest activations
+        float magnitude = 0.0f;
+        for (unsigned int o = 0; o < expected.size(); o++)
+        {
+            magnitude = std::max(magnitude, (float)fabs(expected[o]));
+        }
+        for (unsigned int o = 0; o < expected.size(); o++)
+        {
+            EXPECT_NEAR(expected[o], actions[b][o], 0.02f*magnitude + 0.005f) << "state " << b << ", output " << o;
+        }
+
+        // a state alone gives the same action as in the batch
+        std::vector<float> action;
+        ASSERT_TRUE(policy.act(states[b], width, height, depth, action));
+        for (unsigned int o = 0; o < action.size(); o++)
+        {
+            EXPECT_FLOAT_EQ(actions[b][o], action[o]);
+        }
+    }
+
+    // the flattened cells of other state sizes don't fit the first fully connected layer
+    std::vector<float> action;
+    EXPECT_FALSE(policy.act(std::vector<int8_t>(16*16*depth, 50), 16, 16, depth, action));
+    EXPECT_FALSE(policy.act(states[0], width, height, depth - 1, action));
+}
+
+
+// The layers are checked when loading, not when acting
+TEST(QuantizedPolicy, rejectsBrokenLayers)
+{
+    QuantizedPolicy policy;
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 4, 8);
+        EXPECT_FALSE(policy.load(file.write()));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 32, 8);
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 1, 1, 8, 8);
+        EXPECT_FALSE(policy.load(file.write()));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 6, 8);
+        EXPECT_FALSE(policy.load(file.write()));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 36, 8);
+        EXPECT_FALSE(policy.load(file.write()));
+    }
+
+    {
+        NetworkFile file;
+        file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 32, 8);
+        file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 4, 2);
+        EXPECT_FALSE(policy.load(file.write()));
+    }
+    EXPECT_FALSE(policy.isLoaded());
+
+    NetworkFile file;
+    file.addLayer(NetworkLayer::CONVOLUTION, NetworkLayer::RELU, 3, 2, 4, 8);
+    file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::RELU, 0, 0, 32, 8);
+    file.addLayer(NetworkLayer::FULLY_CONNECTED, NetworkLayer::LINEAR, 0, 0, 8, 2);
+    EXPECT_TRUE(policy.load(file.write()));
+    EXPECT_TRUE(policy.isLoaded());
+}
@@ -0,0 +1,137 @@
+#include <neuro_local_planner_wrapper/state_rasterizer.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <vector>
+
+using neuro_local_planner_wrapper::RasterGeometry;
+using neuro_local_planner_wrapper::StateRasterizer;
+using neuro_local_planner_wrapper::PLAN_MAX_LEVEL;
+
+typedef StateRasterizer<0, 0> Rasterizer;
+
+
+// Helper function to get an empty state of width x height gray cells
+static RasterGeometry makeGeometry(int width, int height, std::vector<int8_t>& data)
+{
+    RasterGeometry geometry;
+    geometry.width = width;
+    geometry.height = height;
+    geometry.origin_x = -width*0.05/2.0;
+    geometry.origin_y = -height*0.05/2.0;
+    geometry.cells_per_meter = 20.0;
+    data.assign(width*height, 50);
+    return geometry;
+}
+
+
+// Every step of the line sets one cell which touches the previous one, up to the end of the segment
+TEST(StateRasterizer, segmentHasNoGaps)
+{
+    std::vector<int8_t> data;
+    RasterGeometry geometry = makeGeometry(32, 32, data);
+
+    int level = 0, progress = 0;
+    Rasterizer::addPlanSegment(geometry, 2, 3, 25, 12, level, progress, 1000, &data[0]);
+
+    int x = 2, y = 3;
+    int count = 0;
+    while (x != 25 || y != 12)
+    {
+        // the next cell is one of the neighbours in the direction of the end
+        bool found = false;
+        for (int dy = 0; dy <= 1 && !found; dy++)
+        {
+            for (int dx = 0; dx <= 1 && !found; dx++)
+            {
+                if ((dx || dy) && data[(x + dx) + (y + dy)*32] < 50)
+                {
+                    x += dx;
+                    y += dy;
+                    found = true;
+                }
+            }
+        }
+        ASSERT_TRUE(found) << "gap after cell " << x << ", " << y;
+        count++;
+    }
+
+    // one cell per step of the longer axis, the start cell belongs to the previous segment
+    EXPECT_EQ(23, count);
+    EXPECT_EQ(50, data[2 + 3*32]);
+}
+
+
+// Straight steps are 5 chamfer units and diagonal ones 7, the level grows by one every units_per_level units
+TEST(StateRasterizer, levelGrowsWithPathLength)
+{
+    std::vector<int8_t> data;
+    RasterGeometry geometry = makeGeometry(32, 32, data);
+
+    int level = 0, progress = 0;
+    Rasterizer::addPlanSegment(geometry, 0, 0, 20, 0, level, progress, 10, &data[0]);
+    for (int x = 1; x <= 20; x++)
+    {
+        EXPECT_EQ((5*x)/10, data[x]) << "straight cell " << x;
+    }
+    EXPECT_EQ(10, level);
+    EXPECT_EQ(0, progress);
+
+    level = 0;
+    progress = 0;
+    Rasterizer::addPlanSegment(geometry, 0, 1, 10, 11, level, progress, 14, &data[0]);
+    for (int k = 1; k <= 10; k++)
+    {
+        EXPECT_EQ((7*k)/14, data[k + (1 + k)*32]) << "diagonal cell " << k;
+    }
+
+    // the progress is carried over to the next segment
+    Rasterizer::addPlanSegment(geometry, 10, 11, 11, 11, level, progress, 14, &data[0]);
+    EXPECT_EQ((7*10 + 5)/14, data[11 + 11*32]);
+}
+
+
+// A goal far outside of the state only adds path length, the visible plan saturates clearly below the background
+TEST(StateRasterizer, farGoalStaysVisible)
+{
+    std::vector<int8_t> data;
+    RasterGeometry geometry = makeGeometry(32, 32, data);
+
+    int level = 0, progress = 0;
+    Rasterizer::addPlanSegment(geometry, 500, 16, 40, 16, level, progress, 5, &data[0]);
+    EXPECT_EQ(PLAN_MAX_LEVEL, level);
+    for (unsigned int i = 0; i < data.size(); i++)
+    {
+        ASSERT_EQ(50, data[i]);
+    }
+
+    Rasterizer::addPlanSegment(geometry, 40, 16, 0, 16, level, progress, 5, &data[0]);
+    for (int x = 0; x < 32; x++)
+    {
+        EXPECT_EQ(PLAN_MAX_LEVEL, data[x + 16*32]);
+    }
+
+    // at least 0.2 apart from the background after the scaling of the planning node
+    EXPECT_LE(PLAN_MAX_LEVEL, 30);
+}
+
+
+// Obstacles are not overwritten and crossings keep the level closer to the goal
+TEST(StateRasterizer, cellKeepsObstaclesAndBrighterLevels)
+{
+    std::vector<int8_t> data;
+    RasterGeometry geometry = makeGeometry(8, 8, data);
+
+    data[1 + 1*8] = 100;
+    Rasterizer::addPlanCell(geometry, 1, 1, 0, &data[0]);
+    EXPECT_EQ(100, data[1 + 1*8]);
+
+    Rasterizer::addPlanCell(geometry, 2, 2, 10, &data[0]);
+    Rasterizer::addPlanCell(geometry, 2, 2, 20, &data[0]);
+    EXPECT_EQ(10, data[2 + 2*8]);
+
+    // outside of the state nothing happens
+    Rasterizer::addPlanCell(geometry, -1, 2, 0, &data[0]);
+    Rasterizer::addPlanCell(geometry, 8, 2, 0, &data[0]);
+}
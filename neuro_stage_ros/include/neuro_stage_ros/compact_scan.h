@@ -0,0 +1,72 @@
+#ifndef NEURO_STAGE_ROS_COMPACT_SCAN_H_
+#define NEURO_STAGE_ROS_COMPACT_SCAN_H_
+
+#include <neuro_stage_ros/CompactScan.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include <limits>
+
+namespace neuro_stage_ros
+{
+    // Millimetres per meter of the compact ranges
+    const float COMPACT_SCAN_SCALE = 1000.0f;
+
+    // Compact range of +inf and NaN, i.e. of a missing return
+    const uint16_t COMPACT_SCAN_NO_RETURN = 65535;
+
+    // Rounds the ranges of a laser scan to millimetres, the intensities are dropped
+    inline void encodeCompactScan(const sensor_msgs::LaserScan& scan, CompactScan& compact)
+    {
+        compact.header = scan.header;
+        compact.angle_min = scan.angle_min;
+        compact.angle_max = scan.angle_max;
+        compact.angle_increment = scan.angle_increment;
+        compact.range_min = scan.range_min;
+        compact.range_max = scan.range_max;
+
+        compact.ranges.resize(scan.ranges.size());
+        for (size_t i = 0; i < scan.ranges.size(); i++)
+        {
+            // Negative ranges become 0, finite ranges are clamped below the value of a missing return
+            float range = scan.ranges[i];
+            if (!(range <= std::numeric_limits<float>::max()))
+            {
+                compact.ranges[i] = COMPACT_SCAN_NO_RETURN;
+            }
+            else
+            {
+                range = range*COMPACT_SCAN_SCALE + 0.5f;
+                compact.ranges[i] = range > 0.0f ? (range < 65534.0f ? (uint16_t)range : 65534) : 0;
+            }
+        }
+    }
+
+
+    // Restores a laser scan without intensities
+    inline void decodeCompactScan(const CompactScan& compact, sensor_msgs::LaserScan& scan)
+    {
+        scan.header = compact.header;
+        scan.angle_min = compact.angle_min;
+        scan.angle_max = compact.angle_max;
+        scan.angle_increment = compact.angle_increment;
+        scan.time_increment = 0.0f;
+        scan.scan_time = 0.0f;
+        scan.range_min = compact.range_min;
+        scan.range_max = compact.range_max;
+        scan.intensities.clear();
+
+        scan.ranges.resize(compact.ranges.size());
+        for (size_t i = 0; i < compact.ranges.size(); i++)
+        {
+            if (compact.ranges[i] == COMPACT_SCAN_NO_RETURN)
+            {
+                scan.ranges[i] = std::numeric_limits<float>::infinity();
+            }
+            else
+            {
+                scan.ranges[i] = compact.ranges[i]/COMPACT_SCAN_SCALE;
+            }
+        }
+    }
+};
+#endif
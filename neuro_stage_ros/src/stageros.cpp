@@ -46,6 +46,7 @@
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <nav_msgs/Odometry.h>
+#include <nav_msgs/OccupancyGrid.h>
 #include <geometry_msgs/Twist.h>
 #include <rosgraph_msgs/Clock.h>
 #include <visualization_msgs/Marker.h>
@@ -54,8 +55,17 @@
 #include <geometry_msgs/PoseStamped.h>
 #include "tf/LinearMath/Transform.h"
 #include <std_srvs/Empty.h>
+#include <neuro_stage_ros/Observation.h>
+#include <neuro_stage_ros/compact_scan.h>
+#include <neuro_msgs/Contact.h>
 
-#include "tf/transform_broadcaster.h"
+#include "tf/transform_datatypes.h"
+#include <tf2_ros/transform_broadcaster.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+
+#include <map>
+#include <limits>
+#include <cmath>
 
 #define USAGE "stageros <worldfile>"
 #define IMAGE "image"
@@ -63,6 +73,11 @@
 #define CAMERA_INFO "camera_info"
 #define ODOM "odom"
 #define BASE_SCAN "base_scan"
+#define MERGED_SCAN "merged_scan"
+#define OBSERVATION "observation"
+#define COMPACT_SCAN "compact_scan"
+#define CONTACT "contact"
+#define MAP "map"
 #define BASE_POSE_GROUND_TRUTH "base_pose_ground_truth"
 #define CMD_VEL "cmd_vel"
 #define POSE "cmd_pose"
@@ -84,6 +99,60 @@ private:
     std::vector<Stg::ModelRanger *> lasermodels;
     std::vector<Stg::ModelPosition *> positionmodels;
 
+    // Models which are not part of a robot, i.e. the static geometry of the world
+    std::vector<Stg::Model *> staticmodels;
+
+    //one sensor of a ranger, a ranger can have several sensors
+    struct StageLaser
+    {
+        Stg::ModelRanger* lasermodel;
+        size_t sensor;
+    };
+
+    //noise model of a laser with its own xoroshiro128+ random numbers, applied while the ranges are copied
+    struct LaserNoise
+    {
+        double range_sigma; //gaussian range noise (m)
+        uint32_t dropout_threshold; //returns +inf (no return) if a uniform 32 bit number is below this
+        uint32_t max_range_threshold; //returns range_max if a uniform 32 bit number is below this
+        double angular_jitter; //gaussian offset of the angles of a whole scan (rad)
+        uint64_t state[2];
+
+        bool isActive() const
+        {
+            return range_sigma > 0.0 || dropout_threshold > 0 || max_range_threshold > 0 || angular_jitter > 0.0;
+        }
+
+        uint64_t next()
+        {
+            uint64_t s0 = state[0];
+            uint64_t s1 = state[1];
+            uint64_t result = s0 + s1;
+            s1 ^= s0;
+            state[0] = ((s0 << 55) | (s0 >> 9)) ^ s1 ^ (s1 << 14);
+            state[1] = (s1 << 36) | (s1 >> 28);
+            return result;
+        }
+
+        // Approximately standard normal, the sum of the four 16 bit parts of one random number scaled to unit
+        // variance, which avoids log and sqrt for every beam
+        double gaussian()
+        {
+            uint64_t r = next();
+            double sum = (double)(r & 0xffff) + (double)((r >> 16) & 0xffff) + (double)((r >> 32) & 0xffff) +
+                         (double)(r >> 48);
+            return (sum/65536.0 - 2.0)*1.7320508075688772;
+        }
+    };
+
+    //origin and direction of a beam in the base frame, the bin of the merged scan depends on where the beam hits
+    struct MergedBeam
+    {
+        double origin_x, origin_y;
+        double direction_x, direction_y;
+        double range_max;
+    };
+
     //a structure representing a robot inthe simulator
     struct StageRobot
     {
@@ -91,22 +160,37 @@ private:
         Stg::ModelPosition* positionmodel; //one position
         std::vector<Stg::ModelCamera *> cameramodels; //multiple cameras per position
         std::vector<Stg::ModelRanger *> lasermodels; //multiple rangers per position
+        std::vector<StageLaser> lasers; //all sensors of all rangers, one laser scan each
+        std::vector<LaserNoise> laser_noises; //noise model of each laser
+        std::vector<sensor_msgs::LaserScan> laser_msgs; //last scan of each laser, reused for every scan
+        std::vector<ros::Publisher> compact_scan_pubs; //optional millimetre ranges of each laser
+        std::vector<neuro_stage_ros::CompactScan> compact_scan_msgs;
 
         //ros publishers
         ros::Publisher odom_pub; //one odom
         ros::Publisher ground_truth_pub; //one ground truth
+        ros::Publisher contact_pub; //one stall and clearance
 
         std::vector<ros::Publisher> image_pubs; //multiple images
         std::vector<ros::Publisher> depth_pubs; //multiple depths
         std::vector<ros::Publisher> camera_pubs; //multiple cameras
         std::vector<ros::Publisher> laser_pubs; //multiple lasers
 
+        //optional 360 degree scan merged from all lasers, the beams of all lasers one after another
+        ros::Publisher merged_scan_pub;
+        std::vector<MergedBeam> merged_beams;
+        sensor_msgs::LaserScan merged_scan;
+
+        //optional observation with all of the above in one message, reused for every step
+        ros::Publisher observation_pub;
+        neuro_stage_ros::Observation observation;
+
         ros::Subscriber cmdvel_sub; //one cmd_vel subscriber
         ros::Subscriber pose_sub;
         ros::Subscriber posestamped_sub;
     };
 
-    std::vector<StageRobot const *> robotmodels_;
+    std::vector<StageRobot *> robotmodels_;
 
     // Publishers for the dynamic obstacle markers
     ros::Publisher vis_pub_1;
@@ -122,6 +206,43 @@ private:
     bool isDepthCanonical;
     bool use_model_names;
 
+    // Should we publish a merged 360 degree scan of all lasers of each robot and with how many beams?
+    bool merge_scans;
+    int merged_scan_beams;
+
+    // Should we publish one observation message per robot and step?
+    bool publish_observation;
+
+    // Should we publish the scans with millimetre ranges as well?
+    bool publish_compact_scans;
+
+    // Should we publish the static world as occupancy grid, with which resolution and in which frame?
+    bool publish_map;
+    double map_resolution;
+    std::string map_frame;
+    ros::Publisher map_pub_;
+
+    // Should we save a checkpoint of the simulation every checkpoint_interval seconds of simulation time and resume
+    // from it on start?
+    std::string checkpoint_file;
+    double checkpoint_interval;
+    bool resume;
+    ros::Time last_checkpoint_time;
+
+    // Simulation time of the checkpoint we resumed from, stage itself starts again at 0
+    double sim_time_offset;
+
+    // Writes the poses and velocities of all robots, the simulation time and the state of the laser noise to a
+    // temporary file which then replaces the checkpoint, so a crash while writing leaves the last checkpoint intact.
+    // Models which are no position models, e.g. obstacles dragged in the GUI, are not saved.
+    bool writeCheckpoint(const std::string& file_name);
+
+    // Restores a checkpoint written by writeCheckpoint, nothing is changed if it doesn't match the world
+    bool readCheckpoint(const std::string& file_name);
+
+    // Rasterizes the static models into an occupancy grid covering all of them
+    void rasterizeMap(nav_msgs::OccupancyGrid& map);
+
     // A helper function that is executed for each stage model.  We use it
     // to search for models of interest.
     static void ghfunc(Stg::Model* mod, StageNode* node);
@@ -139,7 +260,28 @@ private:
     const char *mapName(const char *name, size_t robotID, Stg::Model* mod) const;
     const char *mapName(const char *name, size_t robotID, size_t deviceID, Stg::Model* mod) const;
 
-    tf::TransformBroadcaster tf;
+    tf2_ros::TransformBroadcaster tf;
+
+    // The mounts of the sensors are sent with the static broadcaster, only when they appear or change
+    tf2_ros::StaticTransformBroadcaster static_tf;
+    std::map<std::string, tf::Transform> static_transforms;
+
+    void sendTransform(const tf::Transform& transform, const std::string& parent_frame, const std::string& child_frame);
+    void sendStaticTransform(const tf::Transform& transform, const std::string& parent_frame,
+                             const std::string& child_frame);
+
+    // Pose of a laser relative to its robot, the ranger pose combined with the pose of the sensor
+    static Stg::Pose getLaserPose(const StageLaser& laser);
+
+    // The merged scan maps every beam to a fixed bin, as the lasers don't move on the robot this is computed once
+    void initializeMergedScan(StageRobot* robot, const std::string& frame_id);
+    void mergeScans(StageRobot* robot);
+
+    // Reads the noise model of a laser from ~laser_noise/<laser topic>/..., falling back to ~laser_noise/...
+    void initializeLaserNoise(LaserNoise& noise, const std::string& topic, uint64_t seed);
+
+    // Copies the ranges of a sensor into a laser scan and applies the noise model on the way
+    static void copyRanges(const Stg::ModelRanger::Sensor& sensor, LaserNoise& noise, sensor_msgs::LaserScan& msg);
 
     // Last time that we received a velocity command
     ros::Time base_last_cmd;
@@ -251,6 +393,212 @@ StageNode::mapName(const char *name, size_t robotID, size_t deviceID, Stg::Model
     }
 }
 
+void
+StageNode::sendTransform(const tf::Transform& transform, const std::string& parent_frame,
+                         const std::string& child_frame)
+{
+    geometry_msgs::TransformStamped msg;
+    tf::transformStampedTFToMsg(tf::StampedTransform(transform, sim_time, parent_frame, child_frame), msg);
+    tf.sendTransform(msg);
+}
+
+// The static broadcaster latches all transforms it has sent, so a mount is only sent again if it changed
+void
+StageNode::sendStaticTransform(const tf::Transform& transform, const std::string& parent_frame,
+                               const std::string& child_frame)
+{
+    std::map<std::string, tf::Transform>::iterator it = static_transforms.find(child_frame);
+    if (it != static_transforms.end() && it->second == transform)
+        return;
+
+    static_transforms[child_frame] = transform;
+
+    geometry_msgs::TransformStamped msg;
+    tf::transformStampedTFToMsg(tf::StampedTransform(transform, sim_time, parent_frame, child_frame), msg);
+    static_tf.sendTransform(msg);
+}
+
+Stg::Pose
+StageNode::getLaserPose(const StageLaser& laser)
+{
+    Stg::Pose lp = laser.lasermodel->GetPose();
+    const Stg::Pose& sp = laser.lasermodel->GetSensors()[laser.sensor].pose;
+    return Stg::Pose(lp.x + cos(lp.a)*sp.x - sin(lp.a)*sp.y,
+                     lp.y + sin(lp.a)*sp.x + cos(lp.a)*sp.y,
+                     lp.z + sp.z,
+                     lp.a + sp.a);
+}
+
+// The beams only depend on the mounts of the lasers, the bin of a return is taken from the bearing of the hit point
+// seen from base_link, which differs from the direction of the beam if the laser is not mounted at the origin
+void
+StageNode::initializeMergedScan(StageRobot* robot, const std::string& frame_id)
+{
+    double bin_increment = 2.0*M_PI/merged_scan_beams;
+    double range_min = std::numeric_limits<double>::max();
+    double range_max = 0.0;
+
+    robot->merged_beams.clear();
+    for (size_t l = 0; l < robot->lasers.size(); ++l)
+    {
+        const Stg::ModelRanger::Sensor& sensor = robot->lasers[l].lasermodel->GetSensors()[robot->lasers[l].sensor];
+        Stg::Pose lp = getLaserPose(robot->lasers[l]);
+        double increment = sensor.sample_count > 1 ? sensor.fov/(double)(sensor.sample_count-1) : 0.0;
+
+        for (unsigned int i = 0; i < sensor.sample_count; i++)
+        {
+            double angle = lp.a - sensor.fov/2.0 + i*increment;
+
+            MergedBeam beam;
+            beam.origin_x = lp.x;
+            beam.origin_y = lp.y;
+            beam.direction_x = cos(angle);
+            beam.direction_y = sin(angle);
+            beam.range_max = sensor.range.max;
+            robot->merged_beams.push_back(beam);
+        }
+
+        range_min = std::min(range_min, (double)sensor.range.min);
+        range_max = std::max(range_max, sensor.range.max + hypot(lp.x, lp.y));
+    }
+
+    sensor_msgs::LaserScan& msg = robot->merged_scan;
+    msg.header.frame_id = frame_id;
+    msg.angle_min = -M_PI;
+    msg.angle_increment = bin_increment;
+    msg.angle_max = M_PI - bin_increment;
+    msg.range_min = robot->lasers.empty() ? 0.0 : range_min;
+    msg.range_max = range_max;
+    msg.ranges.resize(merged_scan_beams);
+    msg.intensities.resize(merged_scan_beams);
+}
+
+// Keeps the closest return of each bin, bins without any return are infinite
+void
+StageNode::mergeScans(StageRobot* robot)
+{
+    sensor_msgs::LaserScan& msg = robot->merged_scan;
+    std::fill(msg.ranges.begin(), msg.ranges.end(), std::numeric_limits<float>::infinity());
+    std::fill(msg.intensities.begin(), msg.intensities.end(), 0.0f);
+
+    // the scans of the lasers are merged as published, i.e. with their noise
+    size_t b = 0;
+    for (size_t l = 0; l < robot->lasers.size(); ++l)
+    {
+        const Stg::ModelRanger::Sensor& sensor = robot->lasers[l].lasermodel->GetSensors()[robot->lasers[l].sensor];
+        const sensor_msgs::LaserScan& scan = robot->laser_msgs[l];
+        if (scan.ranges.size() != sensor.sample_count || b + sensor.sample_count > robot->merged_beams.size())
+        {
+            b += sensor.sample_count;
+            continue;
+        }
+
+        for (unsigned int i = 0; i < sensor.sample_count; i++, b++)
+        {
+            const MergedBeam& beam = robot->merged_beams[b];
+            // also skips dropouts (+inf) and NaN
+            if (!(scan.ranges[i] > scan.range_min && scan.ranges[i] < beam.range_max))
+                continue;
+
+            double x = beam.origin_x + scan.ranges[i]*beam.direction_x;
+            double y = beam.origin_y + scan.ranges[i]*beam.direction_y;
+            // the nearest bin, so each bin is centred on its published angle; atan2 gives [-pi, pi] and the
+            // bearings close to pi wrap around to the bin of -pi
+            int bin = (int)floor((atan2(y, x) + M_PI)/msg.angle_increment + 0.5) % merged_scan_beams;
+
+            float range = (float)sqrt(x*x + y*y);
+            if (range < msg.ranges[bin])
+            {
+                msg.ranges[bin] = range;
+                msg.intensities[bin] = i < scan.intensities.size() ? scan.intensities[i] : 0.0f;
+            }
+        }
+    }
+
+    msg.header.stamp = sim_time;
+    robot->merged_scan_pub.publish(msg);
+}
+
+// The state of the random numbers is seeded with splitmix64 as recommended for xoroshiro128+
+void
+StageNode::initializeLaserNoise(LaserNoise& noise, const std::string& topic, uint64_t seed)
+{
+    ros::NodeHandle noise_n("~laser_noise");
+    size_t start = topic.find_first_not_of('/');
+    std::string laser = start == std::string::npos ? std::string() : topic.substr(start);
+
+    double range_sigma, dropout_probability, max_range_probability, angular_jitter;
+    if (!noise_n.getParam(laser + "/range_sigma", range_sigma))
+        noise_n.param("range_sigma", range_sigma, 0.0);
+    if (!noise_n.getParam(laser + "/dropout_probability", dropout_probability))
+        noise_n.param("dropout_probability", dropout_probability, 0.0);
+    if (!noise_n.getParam(laser + "/max_range_probability", max_range_probability))
+        noise_n.param("max_range_probability", max_range_probability, 0.0);
+    if (!noise_n.getParam(laser + "/angular_jitter", angular_jitter))
+        noise_n.param("angular_jitter", angular_jitter, 0.0);
+
+    noise.range_sigma = range_sigma;
+    noise.dropout_threshold = (uint32_t)(std::max(0.0, std::min(1.0, dropout_probability))*4294967295.0);
+    noise.max_range_threshold = (uint32_t)(std::max(0.0, std::min(1.0, max_range_probability))*4294967295.0);
+    noise.angular_jitter = angular_jitter;
+
+    for (int i = 0; i < 2; i++)
+    {
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+        noise.state[i] = z ^ (z >> 31);
+    }
+
+    if (noise.isActive())
+        ROS_INFO("Noise on %s: range sigma %f, dropouts %f, max range returns %f, angular jitter %f", laser.c_str(),
+                 range_sigma, dropout_probability, max_range_probability, angular_jitter);
+}
+
+// The scan keeps the nominal angles of the sensor, the jitter of a scan shifts all its angles
+void
+StageNode::copyRanges(const Stg::ModelRanger::Sensor& sensor, LaserNoise& noise, sensor_msgs::LaserScan& msg)
+{
+    double jitter = noise.angular_jitter > 0.0 ? noise.angular_jitter*noise.gaussian() : 0.0;
+    msg.angle_min = -sensor.fov/2.0 + jitter;
+    msg.angle_max = +sensor.fov/2.0 + jitter;
+    msg.angle_increment = sensor.fov/(double)(sensor.sample_count-1);
+    msg.range_min = sensor.range.min;
+    msg.range_max = sensor.range.max;
+    msg.ranges.resize(sensor.ranges.size());
+    msg.intensities.resize(sensor.intensities.size());
+
+    for(unsigned int i = 0; i < sensor.intensities.size(); i++)
+        msg.intensities[i] = (uint8_t)sensor.intensities[i];
+
+    if (!noise.isActive())
+    {
+        for(unsigned int i = 0; i < sensor.ranges.size(); i++)
+            msg.ranges[i] = sensor.ranges[i];
+        return;
+    }
+
+    // Returns at max range stay there, everything else gets gaussian noise and is clamped to the valid ranges. A
+    // dropout is published as +inf as REP-117 asks for a missing return, a range of 0 would be an obstacle at the laser
+    // for the usual range_min of 0.
+    for(unsigned int i = 0; i < sensor.ranges.size(); i++)
+    {
+        double range = sensor.ranges[i];
+        if (range < sensor.range.max && noise.range_sigma > 0.0)
+            range = std::max((double)sensor.range.min,
+                             std::min(sensor.range.max, range + noise.range_sigma*noise.gaussian()));
+
+        uint32_t event = (uint32_t)(noise.next() >> 32);
+        if (event < noise.dropout_threshold)
+            range = std::numeric_limits<double>::infinity();
+        else if (event - noise.dropout_threshold < noise.max_range_threshold)
+            range = sensor.range.max;
+
+        msg.ranges[i] = range;
+    }
+}
+
 void
 StageNode::ghfunc(Stg::Model* mod, StageNode* node)
 {
@@ -264,9 +612,195 @@ StageNode::ghfunc(Stg::Model* mod, StageNode* node)
     }
     if (dynamic_cast<Stg::ModelCamera *>(mod))
         node->cameramodels.push_back(dynamic_cast<Stg::ModelCamera *>(mod));
+
+    // everything that is neither a robot nor mounted on one and that lasers can see belongs to the static world
+    bool is_static = mod->GetObstacleReturn();
+    for (Stg::Model* m = mod; m && is_static; m = m->Parent())
+        is_static = !dynamic_cast<Stg::ModelPosition *>(m);
+    if (is_static)
+        node->staticmodels.push_back(mod);
 }
 
+// Stage rasterizes the blocks of a model into a raster of the model size centered on the model, the occupied cells
+// are moved into the world with the global pose of the model
+void
+StageNode::rasterizeMap(nav_msgs::OccupancyGrid& map)
+{
+    double min_x = std::numeric_limits<double>::max(), min_y = std::numeric_limits<double>::max();
+    double max_x = -std::numeric_limits<double>::max(), max_y = -std::numeric_limits<double>::max();
+    for (size_t m = 0; m < this->staticmodels.size(); m++)
+    {
+        Stg::Pose pose = this->staticmodels[m]->GetGlobalPose();
+        Stg::Geom geom = this->staticmodels[m]->GetGeom();
+        for (int corner = 0; corner < 4; corner++)
+        {
+            double lx = (corner & 1 ? 0.5 : -0.5)*geom.size.x;
+            double ly = (corner & 2 ? 0.5 : -0.5)*geom.size.y;
+            double x = pose.x + cos(pose.a)*lx - sin(pose.a)*ly;
+            double y = pose.y + sin(pose.a)*lx + cos(pose.a)*ly;
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+        }
+    }
 
+    map.header.frame_id = map_frame;
+    map.header.stamp = sim_time;
+    map.info.map_load_time = sim_time;
+    map.info.resolution = map_resolution;
+    if (this->staticmodels.empty())
+    {
+        map.info.width = map.info.height = 0;
+        map.data.clear();
+        return;
+    }
+
+    map.info.width = (unsigned int)ceil((max_x - min_x)/map_resolution);
+    map.info.height = (unsigned int)ceil((max_y - min_y)/map_resolution);
+    map.info.origin.position.x = min_x;
+    map.info.origin.position.y = min_y;
+    map.info.origin.orientation.w = 1.0;
+    map.data.assign(map.info.width*map.info.height, 0);
+
+    std::vector<uint8_t> raster;
+    for (size_t m = 0; m < this->staticmodels.size(); m++)
+    {
+        Stg::Model* mod = this->staticmodels[m];
+        Stg::Pose pose = mod->GetGlobalPose();
+        Stg::Geom geom = mod->GetGeom();
+        unsigned int width = (unsigned int)ceil(geom.size.x/map_resolution);
+        unsigned int height = (unsigned int)ceil(geom.size.y/map_resolution);
+        if (width == 0 || height == 0)
+            continue;
+
+        raster.assign(width*height, 0);
+        mod->Rasterize(&raster[0], width, height, map_resolution, map_resolution);
+
+        for (unsigned int y = 0; y < height; y++)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                if (!raster[y*width + x])
+                    continue;
+
+                double lx = (x + 0.5)*map_resolution - geom.size.x/2.0;
+                double ly = (y + 0.5)*map_resolution - geom.size.y/2.0;
+                int cell_x = (int)floor((pose.x + cos(pose.a)*lx - sin(pose.a)*ly - min_x)/map_resolution);
+                int cell_y = (int)floor((pose.y + sin(pose.a)*lx + cos(pose.a)*ly - min_y)/map_resolution);
+                if (cell_x >= 0 && cell_y >= 0 && cell_x < (int)map.info.width && cell_y < (int)map.info.height)
+                    map.data[cell_y*map.info.width + cell_x] = 100;
+            }
+        }
+    }
+}
+
+
+
+
+// The checkpoint is binary in the byte order of this machine: magic, version, simulation time and number of robots,
+// then for each robot its global pose and velocity (x, y, z, a) and the xoroshiro128+ state of each of its lasers
+static const char CHECKPOINT_MAGIC[8] = {'N', 'S', 'R', 'C', 'K', 'P', 'T', '\0'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+
+bool
+StageNode::writeCheckpoint(const std::string& file_name)
+{
+    std::string temp_file_name = file_name + ".tmp";
+    FILE* file = fopen(temp_file_name.c_str(), "wb");
+    if (!file)
+    {
+        ROS_ERROR("Could not open checkpoint %s", temp_file_name.c_str());
+        return false;
+    }
+
+    uint32_t header[2] = {CHECKPOINT_VERSION, (uint32_t)this->robotmodels_.size()};
+    double time = this->sim_time.toSec();
+    fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&time, sizeof(time), 1, file);
+
+    for (size_t r = 0; r < this->robotmodels_.size(); ++r)
+    {
+        StageRobot const * robotmodel = this->robotmodels_[r];
+        Stg::Pose pose = robotmodel->positionmodel->GetGlobalPose();
+        Stg::Velocity velocity = robotmodel->positionmodel->GetVelocity();
+        double values[8] = {pose.x, pose.y, pose.z, pose.a, velocity.x, velocity.y, velocity.z, velocity.a};
+        uint32_t laser_count = robotmodel->laser_noises.size();
+        fwrite(values, sizeof(values), 1, file);
+        fwrite(&laser_count, sizeof(laser_count), 1, file);
+
+        for (size_t s = 0; s < robotmodel->laser_noises.size(); ++s)
+            fwrite(robotmodel->laser_noises[s].state, sizeof(robotmodel->laser_noises[s].state), 1, file);
+    }
+
+    bool is_written = !ferror(file);
+    is_written = (fclose(file) == 0) && is_written;
+    if (!is_written || rename(temp_file_name.c_str(), file_name.c_str()) != 0)
+    {
+        ROS_ERROR("Could not write checkpoint %s", file_name.c_str());
+        remove(temp_file_name.c_str());
+        return false;
+    }
+
+    ROS_DEBUG("Wrote checkpoint %s at %f s", file_name.c_str(), time);
+    return true;
+}
+
+bool
+StageNode::readCheckpoint(const std::string& file_name)
+{
+    FILE* file = fopen(file_name.c_str(), "rb");
+    if (!file)
+        return false;
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    uint32_t header[2];
+    double time;
+    bool is_valid = fread(magic, sizeof(magic), 1, file) == 1 && fread(header, sizeof(header), 1, file) == 1 &&
+                    fread(&time, sizeof(time), 1, file) == 1 &&
+                    memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0 && header[0] == CHECKPOINT_VERSION &&
+                    header[1] == this->robotmodels_.size();
+
+    // Everything is read before anything is applied
+    std::vector<double> values(8*this->robotmodels_.size());
+    std::vector<std::vector<LaserNoise> > laser_noises(this->robotmodels_.size());
+    for (size_t r = 0; is_valid && r < this->robotmodels_.size(); ++r)
+    {
+        uint32_t laser_count;
+        is_valid = fread(&values[8*r], 8*sizeof(double), 1, file) == 1 &&
+                   fread(&laser_count, sizeof(laser_count), 1, file) == 1 &&
+                   laser_count == this->robotmodels_[r]->laser_noises.size();
+
+        laser_noises[r] = this->robotmodels_[r]->laser_noises;
+        for (size_t s = 0; is_valid && s < laser_noises[r].size(); ++s)
+            is_valid = fread(laser_noises[r][s].state, sizeof(laser_noises[r][s].state), 1, file) == 1;
+    }
+    fclose(file);
+
+    if (!is_valid)
+    {
+        ROS_ERROR("Checkpoint %s is broken or doesn't match the robots of the world", file_name.c_str());
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(msg_lock);
+    for (size_t r = 0; r < this->robotmodels_.size(); ++r)
+    {
+        const double* v = &values[8*r];
+        this->robotmodels_[r]->positionmodel->SetGlobalPose(Stg::Pose(v[0], v[1], v[2], v[3]));
+        this->robotmodels_[r]->positionmodel->SetSpeed(Stg::Velocity(v[4], v[5], v[6], v[7]));
+        this->robotmodels_[r]->laser_noises = laser_noises[r];
+    }
+
+    // The published time continues where the checkpoint left off, and the watchdog counts from there
+    this->sim_time_offset = time;
+    this->sim_time.fromSec(time);
+    this->base_last_cmd = this->sim_time;
+    this->base_last_globalpos_time = this->sim_time;
+    this->last_checkpoint_time = this->sim_time;
+    return true;
+}
 
 
 bool
@@ -338,6 +872,33 @@ StageNode::StageNode(int argc, char** argv, bool gui, const char* fname, bool us
     if(!localn.getParam("is_depth_canonical", isDepthCanonical))
         isDepthCanonical = true;
 
+    if(!localn.getParam("merge_scans", merge_scans))
+        merge_scans = false;
+    if(!localn.getParam("merged_scan_beams", merged_scan_beams) || merged_scan_beams < 1)
+        merged_scan_beams = 720;
+
+    if(!localn.getParam("publish_observation", publish_observation))
+        publish_observation = false;
+
+    if(!localn.getParam("publish_compact_scans", publish_compact_scans))
+        publish_compact_scans = false;
+
+    if(!localn.getParam("publish_map", publish_map))
+        publish_map = false;
+    if(!localn.getParam("map_resolution", map_resolution) || map_resolution <= 0.0)
+        map_resolution = 0.05;
+    if(!localn.getParam("map_frame", map_frame))
+        map_frame = "map";
+
+    if(!localn.getParam("checkpoint_file", checkpoint_file))
+        checkpoint_file = "";
+    if(!localn.getParam("checkpoint_interval", checkpoint_interval))
+        checkpoint_interval = 60.0;
+    if(!localn.getParam("resume", resume))
+        resume = false;
+    this->sim_time_offset = 0.0;
+    this->last_checkpoint_time.fromSec(0.0);
+
 
     // We'll check the existence of the world file, because libstage doesn't
     // expose its failure to open it.  Could go further with checks (e.g., is
@@ -411,10 +972,23 @@ StageNode::SubscribeModels()
             }
         }
 
-        ROS_INFO("Found %lu laser devices and %lu cameras in robot %lu", new_robot->lasermodels.size(), new_robot->cameramodels.size(), r);
+        // Every sensor of a ranger is published as a laser of its own
+        for (size_t s = 0; s < new_robot->lasermodels.size(); s++)
+        {
+            for (size_t k = 0; k < new_robot->lasermodels[s]->GetSensors().size(); k++)
+            {
+                StageLaser laser;
+                laser.lasermodel = new_robot->lasermodels[s];
+                laser.sensor = k;
+                new_robot->lasers.push_back(laser);
+            }
+        }
+
+        ROS_INFO("Found %lu laser devices with %lu sensors and %lu cameras in robot %lu", new_robot->lasermodels.size(), new_robot->lasers.size(), new_robot->cameramodels.size(), r);
 
         new_robot->odom_pub = n_.advertise<nav_msgs::Odometry>(mapName(ODOM, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10);
         new_robot->ground_truth_pub = n_.advertise<nav_msgs::Odometry>(mapName(BASE_POSE_GROUND_TRUTH, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10);
+        new_robot->contact_pub = n_.advertise<neuro_msgs::Contact>(mapName(CONTACT, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10);
         //new_robot->cmdvel_sub = n_.subscribe<geometry_msgs::Twist>(mapName(CMD_VEL, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10, boost::bind(&StageNode::cmdvelReceived, this, r, _1));
 	    new_robot->cmdvel_sub = n_.subscribe<geometry_msgs::Twist>("/move_base/NeuroLocalPlannerWrapper/action", 10, boost::bind(&StageNode::cmdvelReceived, this, 0, _1));
         //new_robot->pose_sub = n_.subscribe<geometry_msgs::Pose>(mapName(POSE, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10, boost::bind(&StageNode::poseReceived, this, r, _1));
@@ -423,13 +997,42 @@ StageNode::SubscribeModels()
         //new_robot->posestamped_sub = n_.subscribe<geometry_msgs::PoseStamped>(mapName(POSESTAMPED, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10, boost::bind(&StageNode::poseStampedReceived, this, r, _1));
         new_robot->posestamped_sub = n_.subscribe<geometry_msgs::PoseStamped>("neuro_stage_ros/set_pose_stamped", 10, boost::bind(&StageNode::poseStampedReceived, this, 0, _1));
 
-        for (size_t s = 0;  s < new_robot->lasermodels.size(); ++s)
+        // Every laser gets its own random numbers, derived from ~laser_noise/seed
+        int noise_seed;
+        ros::NodeHandle("~laser_noise").param("seed", noise_seed, 42);
+
+        new_robot->laser_noises.resize(new_robot->lasers.size());
+        new_robot->laser_msgs.resize(new_robot->lasers.size());
+        for (size_t s = 0;  s < new_robot->lasers.size(); ++s)
         {
-            if (new_robot->lasermodels.size() == 1)
+            if (new_robot->lasers.size() == 1)
                 new_robot->laser_pubs.push_back(n_.advertise<sensor_msgs::LaserScan>(mapName(BASE_SCAN, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10));
             else
                 new_robot->laser_pubs.push_back(n_.advertise<sensor_msgs::LaserScan>(mapName(BASE_SCAN, r, s, static_cast<Stg::Model*>(new_robot->positionmodel)), 10));
 
+            initializeLaserNoise(new_robot->laser_noises[s], new_robot->laser_pubs[s].getTopic(),
+                                 (uint64_t)noise_seed*1000003ULL + r*1000 + s);
+
+            if (this->publish_compact_scans)
+            {
+                if (new_robot->lasers.size() == 1)
+                    new_robot->compact_scan_pubs.push_back(n_.advertise<neuro_stage_ros::CompactScan>(mapName(COMPACT_SCAN, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10));
+                else
+                    new_robot->compact_scan_pubs.push_back(n_.advertise<neuro_stage_ros::CompactScan>(mapName(COMPACT_SCAN, r, s, static_cast<Stg::Model*>(new_robot->positionmodel)), 10));
+            }
+        }
+        new_robot->compact_scan_msgs.resize(new_robot->compact_scan_pubs.size());
+
+        if (this->merge_scans)
+        {
+            new_robot->merged_scan_pub = n_.advertise<sensor_msgs::LaserScan>(mapName(MERGED_SCAN, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10);
+            initializeMergedScan(new_robot, mapName("base_link", r, static_cast<Stg::Model*>(new_robot->positionmodel)));
+        }
+
+        if (this->publish_observation)
+        {
+            new_robot->observation_pub = n_.advertise<neuro_stage_ros::Observation>(mapName(OBSERVATION, r, static_cast<Stg::Model*>(new_robot->positionmodel)), 10);
+            new_robot->observation.header.frame_id = mapName("odom", r, static_cast<Stg::Model*>(new_robot->positionmodel));
         }
 
         for (size_t s = 0;  s < new_robot->cameramodels.size(); ++s)
@@ -455,12 +1058,31 @@ StageNode::SubscribeModels()
     // advertising reset service
     reset_srv_ = n_.advertiseService("reset_positions", &StageNode::cb_reset_srv, this);
 
+    // The world is loaded once, so its map is rasterized and latched once
+    if (this->publish_map)
+    {
+        map_pub_ = n_.advertise<nav_msgs::OccupancyGrid>(MAP, 1, true);
+        nav_msgs::OccupancyGrid map;
+        rasterizeMap(map);
+        map_pub_.publish(map);
+        ROS_INFO("Published the map of %lu static models with %ux%u cells", this->staticmodels.size(), map.info.width, map.info.height);
+    }
+
+    // Continue a run which was interrupted, a missing checkpoint just starts a new one
+    if (this->resume && !this->checkpoint_file.empty())
+    {
+        if (readCheckpoint(this->checkpoint_file))
+            ROS_INFO("Resumed from checkpoint %s at %f s", this->checkpoint_file.c_str(), this->sim_time_offset);
+        else
+            ROS_WARN("Could not resume from checkpoint %s, starting from the world file", this->checkpoint_file.c_str());
+    }
+
     return(0);
 }
 
 StageNode::~StageNode()
 {    
-    for (std::vector<StageRobot const*>::iterator r = this->robotmodels_.begin(); r != this->robotmodels_.end(); ++r)
+    for (std::vector<StageRobot *>::iterator r = this->robotmodels_.begin(); r != this->robotmodels_.end(); ++r)
         delete *r;
 }
 
@@ -543,7 +1165,7 @@ StageNode::WorldCallback()
 
     vel_pub_.publish(marker_1);
 
-    this->sim_time.fromSec(world->SimTimeNow() / 1e6);
+    this->sim_time.fromSec(world->SimTimeNow() / 1e6 + this->sim_time_offset);
     // We're not allowed to publish clock==0, because it used as a special
     // value in parts of ROS, #4027.
     if(this->sim_time.sec == 0 && this->sim_time.nsec == 0)
@@ -563,70 +1185,80 @@ StageNode::WorldCallback()
     //loop on the robot models
     for (size_t r = 0; r < this->robotmodels_.size(); ++r)
     {
-        StageRobot const * robotmodel = this->robotmodels_[r];
+        StageRobot * robotmodel = this->robotmodels_[r];
 
-        //loop on the laser devices for the current robot
-        for (size_t s = 0; s < robotmodel->lasermodels.size(); ++s)
+        // Publish the stall and the clearance as ground truth collisions, the clearance is taken from the ranges of
+        // Stage before any noise is added. This comes before the scans of the step, so that a subscriber which checks
+        // a scan for collisions already has the contact with the same stamp.
+        if (robotmodel->contact_pub.getNumSubscribers() > 0)
         {
-            Stg::ModelRanger const* lasermodel = robotmodel->lasermodels[s];
-            const std::vector<Stg::ModelRanger::Sensor>& sensors = lasermodel->GetSensors();
-
-            if( sensors.size() > 1 )
-                ROS_WARN( "ROS Stage currently supports rangers with 1 sensor only." );
+            neuro_msgs::Contact contact_msg;
+            contact_msg.header.frame_id = mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
+            contact_msg.header.stamp = sim_time;
+            contact_msg.stall = robotmodel->positionmodel->Stall();
+            contact_msg.min_clearance = std::numeric_limits<float>::infinity();
+            for (size_t s = 0; s < robotmodel->lasers.size(); ++s)
+            {
+                const Stg::ModelRanger::Sensor& sensor = robotmodel->lasers[s].lasermodel->GetSensors()[robotmodel->lasers[s].sensor];
+                for (size_t i = 0; i < sensor.ranges.size(); i++)
+                {
+                    if (sensor.ranges[i] > sensor.range.min && sensor.ranges[i] < sensor.range.max &&
+                        sensor.ranges[i] < contact_msg.min_clearance)
+                        contact_msg.min_clearance = sensor.ranges[i];
+                }
+            }
+            robotmodel->contact_pub.publish(contact_msg);
+        }
 
-            // for now we access only the zeroth sensor of the ranger - good
-            // enough for most laser models that have a single beam origin
-            const Stg::ModelRanger::Sensor& sensor = sensors[0];
+        //loop on the laser sensors of all rangers for the current robot
+        for (size_t s = 0; s < robotmodel->lasers.size(); ++s)
+        {
+            const StageLaser& laser = robotmodel->lasers[s];
+            const Stg::ModelRanger::Sensor& sensor = laser.lasermodel->GetSensors()[laser.sensor];
 
             if( sensor.ranges.size() )
             {
-                // Translate into ROS message format and publish
-                sensor_msgs::LaserScan msg;
-                msg.angle_min = -sensor.fov/2.0;
-                msg.angle_max = +sensor.fov/2.0;
-                msg.angle_increment = sensor.fov/(double)(sensor.sample_count-1);
-                msg.range_min = sensor.range.min;
-                msg.range_max = sensor.range.max;
-                msg.ranges.resize(sensor.ranges.size());
-                msg.intensities.resize(sensor.intensities.size());
-
-                for(unsigned int i = 0; i < sensor.ranges.size(); i++)
-                {
-                    msg.ranges[i] = sensor.ranges[i];
-                    msg.intensities[i] = (uint8_t)sensor.intensities[i];
-                }
+                // Translate into ROS message format with the noise of the laser and publish
+                sensor_msgs::LaserScan& msg = robotmodel->laser_msgs[s];
+                copyRanges(sensor, robotmodel->laser_noises[s], msg);
 
-                if (robotmodel->lasermodels.size() > 1)
+                if (robotmodel->lasers.size() > 1)
                     msg.header.frame_id = mapName("base_laser_link", r, s, static_cast<Stg::Model*>(robotmodel->positionmodel));
                 else
                     msg.header.frame_id = mapName("base_laser_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
 
                 msg.header.stamp = sim_time;
                 robotmodel->laser_pubs[s].publish(msg);
+
+                if (s < robotmodel->compact_scan_pubs.size() && robotmodel->compact_scan_pubs[s].getNumSubscribers() > 0)
+                {
+                    neuro_stage_ros::encodeCompactScan(msg, robotmodel->compact_scan_msgs[s]);
+                    robotmodel->compact_scan_pubs[s].publish(robotmodel->compact_scan_msgs[s]);
+                }
             }
 
-            // Also publish the base->base_laser_link Tx.  This could eventually move
-            // into being retrieved from the param server as a static Tx.
-            Stg::Pose lp = lasermodel->GetPose();
+            // Also publish the base->base_laser_link Tx as static Tx.
+            Stg::Pose lp = getLaserPose(laser);
             tf::Quaternion laserQ;
             laserQ.setRPY(0.0, 0.0, lp.a);
             tf::Transform txLaser =  tf::Transform(laserQ, tf::Point(lp.x, lp.y, robotmodel->positionmodel->GetGeom().size.z + lp.z));
 
-            if (robotmodel->lasermodels.size() > 1)
-                tf.sendTransform(tf::StampedTransform(txLaser, sim_time,
-                                                      mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                                      mapName("base_laser_link", r, s, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+            std::string base_frame = mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
+            if (robotmodel->lasers.size() > 1)
+                sendStaticTransform(txLaser, base_frame,
+                                    mapName("base_laser_link", r, s, static_cast<Stg::Model*>(robotmodel->positionmodel)));
             else
-                tf.sendTransform(tf::StampedTransform(txLaser, sim_time,
-                                                      mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                                      mapName("base_laser_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+                sendStaticTransform(txLaser, base_frame,
+                                    mapName("base_laser_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)));
         }
 
+        if (robotmodel->merged_scan_pub && robotmodel->merged_scan_pub.getNumSubscribers() > 0)
+            mergeScans(robotmodel);
+
         //the position of the robot
-        tf.sendTransform(tf::StampedTransform(tf::Transform::getIdentity(),
-                                              sim_time,
-                                              mapName("base_footprint", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                              mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+        std::string footprint_frame = mapName("base_footprint", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
+        sendStaticTransform(tf::Transform::getIdentity(), footprint_frame,
+                            mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)));
 
         // Get latest odometry data
         // Translate into ROS message format and publish
@@ -639,9 +1271,6 @@ StageNode::WorldCallback()
         odom_msg.twist.twist.linear.y = v.y;
         odom_msg.twist.twist.angular.z = v.a;
 
-        //@todo Publish stall on a separate topic when one becomes available
-        //this->odomMsgs[r].stall = this->positionmodels[r]->Stall();
-        //
         odom_msg.header.frame_id = mapName("odom", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
         odom_msg.header.stamp = sim_time;
 
@@ -651,9 +1280,7 @@ StageNode::WorldCallback()
         tf::Quaternion odomQ;
         tf::quaternionMsgToTF(odom_msg.pose.pose.orientation, odomQ);
         tf::Transform txOdom(odomQ, tf::Point(odom_msg.pose.pose.position.x, odom_msg.pose.pose.position.y, 0.0));
-        tf.sendTransform(tf::StampedTransform(txOdom, sim_time,
-                                              mapName("odom", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                              mapName("base_footprint", r, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+        sendTransform(txOdom, odom_msg.header.frame_id, footprint_frame);
 
         // Also publish the ground truth pose and velocity
         Stg::Pose gpose = robotmodel->positionmodel->GetGlobalPose();
@@ -694,6 +1321,20 @@ StageNode::WorldCallback()
 
         robotmodel->ground_truth_pub.publish(ground_truth_msg);
 
+        // Bundle this step of the robot into one message, so that subscribers don't have to synchronize the topics
+        if (robotmodel->observation_pub && robotmodel->observation_pub.getNumSubscribers() > 0)
+        {
+            neuro_stage_ros::Observation& observation = robotmodel->observation;
+            observation.header.stamp = sim_time;
+            observation.scans = robotmodel->laser_msgs;
+            observation.odom_pose = odom_msg.pose.pose;
+            observation.odom_twist = odom_msg.twist.twist;
+            observation.ground_truth_pose = ground_truth_msg.pose.pose;
+            observation.ground_truth_twist = ground_truth_msg.twist.twist;
+            observation.stall = robotmodel->positionmodel->Stall();
+            robotmodel->observation_pub.publish(observation);
+        }
+
         //cameras
         for (size_t s = 0; s < robotmodel->cameramodels.size(); ++s)
         {
@@ -805,14 +1446,13 @@ StageNode::WorldCallback()
 
                 tf::Transform tr =  tf::Transform(Q, tf::Point(lp.x, lp.y, robotmodel->positionmodel->GetGeom().size.z+lp.z));
 
+                std::string base_frame = mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel));
                 if (robotmodel->cameramodels.size() > 1)
-                    tf.sendTransform(tf::StampedTransform(tr, sim_time,
-                                                          mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                                          mapName("camera", r, s, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+                    sendStaticTransform(tr, base_frame,
+                                        mapName("camera", r, s, static_cast<Stg::Model*>(robotmodel->positionmodel)));
                 else
-                    tf.sendTransform(tf::StampedTransform(tr, sim_time,
-                                                          mapName("base_link", r, static_cast<Stg::Model*>(robotmodel->positionmodel)),
-                                                          mapName("camera", r, static_cast<Stg::Model*>(robotmodel->positionmodel))));
+                    sendStaticTransform(tr, base_frame,
+                                        mapName("camera", r, static_cast<Stg::Model*>(robotmodel->positionmodel)));
 
                 sensor_msgs::CameraInfo camera_msg;
                 if (robotmodel->cameramodels.size() > 1)
@@ -862,6 +1502,14 @@ StageNode::WorldCallback()
     }
 
     this->base_last_globalpos_time = this->sim_time;
+
+    if (!this->checkpoint_file.empty() && this->checkpoint_interval > 0.0 &&
+        (this->sim_time - this->last_checkpoint_time).toSec() >= this->checkpoint_interval)
+    {
+        writeCheckpoint(this->checkpoint_file);
+        this->last_checkpoint_time = this->sim_time;
+    }
+
     rosgraph_msgs::Clock clock_msg;
     clock_msg.clock = sim_time;
     this->clock_pub_.publish(clock_msg);
@@ -20,9 +20,11 @@ ros::Publisher move_base_goal_pub;
 // Uncomment when using real amcl localization
 // ros::Publisher move_base_pose_pub;
 int sampleArea = 1;
-unsigned int pixel_position;
 bool costmap_there = false;
 
+// Free space around sampled positions, needed for maps without inflation like the one of neuro_stage_ros
+double map_clearance = 0.0;
+
 double x_max = 1.20;
 double x_min = -1.40;
 double y_max = 3.40;
@@ -51,6 +53,40 @@ double dist(double x_1, double y_1, double x_2, double y_2)
     return sqrt(pow((x_1 - x_2), 2.0) + pow((y_1 - y_2), 2.0));
 }
 
+// Checks the cells within map_clearance of a position, positions outside of the map are occupied
+bool isOccupied(double x, double y)
+{
+    const nav_msgs::MapMetaData& info = current_costmap.info;
+    if (info.resolution <= 0.0)
+    {
+        return false;
+    }
+
+    int radius = (int)ceil(map_clearance / info.resolution);
+    int cell_x = (int)floor((x - info.origin.position.x) / info.resolution);
+    int cell_y = (int)floor((y - info.origin.position.y) / info.resolution);
+
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        for (int dx = -radius; dx <= radius; dx++)
+        {
+            if (dx*dx + dy*dy > radius*radius)
+            {
+                continue;
+            }
+
+            int cx = cell_x + dx;
+            int cy = cell_y + dy;
+            if (cx < 0 || cy < 0 || cx >= (int)info.width || cy >= (int)info.height ||
+                current_costmap.data[cy*info.width + cx] > 10)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void publishNewGoal()
 {
     double x;
@@ -76,8 +112,7 @@ void publishNewGoal()
         else
         {
             // Now check for the costmap values
-            pixel_position = (unsigned int)(x / 0.05) + (unsigned int)(y / 0.05) * 200;
-            if (costmap_there && current_costmap.data.at(pixel_position) > 10)
+            if (costmap_there && isOccupied(x, y))
             {
                 collision = true;
             }
@@ -119,8 +154,7 @@ void publishNewPose()
         y = getRandomDouble(y_min, y_max, 2.00);
 
         // First check for the costmap values
-        pixel_position = (unsigned int)(x / 0.05) + (unsigned int)(y / 0.05) * 200;
-        if (costmap_there && current_costmap.data.at(pixel_position) > 10)
+        if (costmap_there && isOccupied(x, y))
         {
             collision = true;
         }
@@ -222,7 +256,13 @@ int main(int argc, char **argv)
     ros::Subscriber sub_planner = n.subscribe("/move_base/NeuroLocalPlannerWrapper/new_round", 1000, botCallback);
     ros::Subscriber sub_recovery = n.subscribe("/move_base/neuro_fake_recovery/new_round", 1000, botCallback);
     ros::Subscriber sub_area = n.subscribe("/sampleArea", 1000, newSampleAreaCallback);
-    ros::Subscriber sub_costmap = n.subscribe("/move_base/global_costmap/costmap", 1000, costmapCallback);
+
+    // Positions are sampled on the global costmap or on the map of the simulator
+    ros::NodeHandle private_n("~");
+    std::string map_topic;
+    private_n.param("map_topic", map_topic, std::string("/move_base/global_costmap/costmap"));
+    private_n.param("map_clearance", map_clearance, 0.0);
+    ros::Subscriber sub_costmap = n.subscribe(map_topic, 1000, costmapCallback);
 
 
     ros::Subscriber sub_robot_1 = n.subscribe("/robot_1/base_pose_ground_truth", 1000, robot_1_callback);